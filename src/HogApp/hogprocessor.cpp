@@ -22,6 +22,7 @@ void HogProcessor::release()
     std::cout << "Mean processing time on " << frameIndex_ << " frames is "
         << (double)msSum_ / std::max(1, frameIndex_) << "ms\n";
     hog_.release();
+    programCache_.release();
     if (oclImage_)
     {
         clReleaseMemObject(oclImage_);
@@ -54,7 +55,13 @@ bool HogProcessor::setupProcessor(const VideoProcessor::CaptureSettings &setting
     {
         return emitError("Failed to initialize oclImage_");
     }
-    if (hog_.initialize(hogSett_, oclContext_, oclProgram_, oclImage_) != CL_SUCCESS)
+    programCache_.initialize(oclContext_, getKernelSource(), oclProgram_);
+    cl_program program = NULL;
+    if (programCache_.program(hogSett_, program) != CL_SUCCESS)
+    {
+        return emitError("Failed to build hog.cl for the HogSettings");
+    }
+    if (hog_.initialize(hogSett_, oclContext_, program, oclImage_) != CL_SUCCESS)
     {
         return emitError("Failed to initialize Hog");
     }
@@ -85,11 +92,11 @@ void HogProcessor::calcHog()
         clReleaseEvent(imageWriteEvent);
         imageWriteEvent = NULL;
     }
-    bytes = hogSett_.descLen() * sizeof(cl_float);
-    cl_float *mappedDesc = NULL;
+    bytes = hogSett_.descLen() * hogSett_.descriptorElementSize();
+    void *mappedDesc = NULL;
     if (status == CL_SUCCESS)
     {
-        mappedDesc = (cl_float*)clEnqueueMapBuffer(oclQueue_, hog_.blockHog_.descriptor_,
+        mappedDesc = clEnqueueMapBuffer(oclQueue_, hog_.blockHog_.descriptor_,
             CL_TRUE, CL_MAP_READ, 0, bytes, 1, &hogEvent, NULL, &status);
     }
     quint64 ms = timer_.restart();
@@ -103,7 +110,7 @@ void HogProcessor::calcHog()
     cl_event unmapEvent = NULL;
     if (mappedDesc)
     {
-        std::copy(mappedDesc, mappedDesc + hogSett_.descLen(), desc_);
+        BlockHog::unpackDescriptor(hogSett_, mappedDesc, hogSett_.descLen(), desc_);
         status = clEnqueueUnmapMemObject(oclQueue_, hog_.blockHog_.descriptor_, mappedDesc,
             0, NULL, &unmapEvent);
     }
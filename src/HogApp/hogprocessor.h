@@ -36,6 +36,7 @@ protected:
     std::shared_ptr<cv::Mat_<float> > ocvImageGrayFloat_ = nullptr;
     cl_mem oclImage_ = NULL;
     HogSettings hogSett_;
+    HogProgramCache programCache_;
     Hog hog_;
     float *desc_ = nullptr;
     QElapsedTimer timer_;
@@ -8,21 +8,40 @@ include($$PWD/../opencl.pri)
 
 INCLUDEPATH += $$OCL_INCLUDE_DIR
 
+# SSE is the baseline of the batched FFT and of HogSimd, AVX2 code is enabled per file via
+# pragmas and dispatched at runtime
+QMAKE_CXXFLAGS += -msse4.1 -mssse3 -msse3 -msse2 -msse
+
 SOURCES += \
     colorconversions.cpp \
     colorconversionsproto.cpp \
+    fft.cpp \
+    fftbatchproto.cpp \
+    fftbatchprotoavx2.cpp \
+    fftcorrelationproto.cpp \
     fftproto.cpp \
+    fftwisdom.cpp \
     hogproto.cpp \
     hog.cpp \
-    rangedkernel.cpp
+    hogsimd.cpp \
+    hogsimdavx2.cpp \
+    rangedkernel.cpp \
+    threadpool.cpp
 
 HEADERS += \
     colorconversions.h \
     colorconversionsproto.h \
+    fft.h \
+    fftbutterflies.h \
+    fftcorrelationproto.h \
     fftproto.h \
+    fftwisdom.h \
     hogproto.h \
     hog.h \
-    rangedkernel.h
+    hogsimd.h \
+    hogsimdkernels.h \
+    rangedkernel.h \
+    threadpool.h
 
 DISTFILES += \
     colorconversions.cl \
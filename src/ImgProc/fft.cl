@@ -53,6 +53,25 @@
     c4 = v0 + v1 + (float2)(-v4.y, v4.x);       \
 }
 
+// Two DFT_3 over the even and the odd inputs joined by e^{-2 \cdot \pi \cdot i \cdot k / 6}
+#define DFT_6(c0, c1, c2, c3, c4, c5)                                       \
+{                                                                           \
+    DFT_3(c0, c2, c4);                                                      \
+    DFT_3(c1, c3, c5);                                                      \
+    float2 e0 = c0, e1 = c2, e2 = c4;                                       \
+    float2 o0 = c1;                                                         \
+    float2 o1 = (float2)(0.5f * c3.x + SQRT3DIV2 * c3.y,                    \
+                         0.5f * c3.y - SQRT3DIV2 * c3.x);                   \
+    float2 o2 = (float2)(-0.5f * c5.x + SQRT3DIV2 * c5.y,                   \
+                         -0.5f * c5.y - SQRT3DIV2 * c5.x);                  \
+    c0 = e0 + o0;                                                           \
+    c3 = e0 - o0;                                                           \
+    c1 = e1 + o1;                                                           \
+    c4 = e1 - o1;                                                           \
+    c2 = e2 + o2;                                                           \
+    c5 = e2 - o2;                                                           \
+}
+
 #define W7_A 0.62348980185873f
 #define W7_B 0.78183148246802f
 #define W7_C 0.22252093395631f
@@ -79,34 +98,246 @@
     c6 = v0 + v1 + (float2)(-v4.y, v4.x);                           \
 }
 
-#define M_2PI_F 6.283185482025146484375f
+#define SQRT2DIV2 0.70710678118654f
+
+// Two DFT_4 over the even and the odd inputs joined by e^{-2 \cdot \pi \cdot i \cdot k / 8}
+#define DFT_8(c0, c1, c2, c3, c4, c5, c6, c7)                               \
+{                                                                           \
+    DFT_4(c0, c2, c4, c6);                                                  \
+    DFT_4(c1, c3, c5, c7);                                                  \
+    float2 e0 = c0, e1 = c2, e2 = c4, e3 = c6;                              \
+    float2 o0 = c1;                                                         \
+    float2 o1 = SQRT2DIV2 * (float2)(c3.x + c3.y, c3.y - c3.x);             \
+    float2 o2 = (float2)(c5.y, -c5.x);                                      \
+    float2 o3 = SQRT2DIV2 * (float2)(c7.y - c7.x, -c7.x - c7.y);            \
+    c0 = e0 + o0;                                                           \
+    c4 = e0 - o0;                                                           \
+    c1 = e1 + o1;                                                           \
+    c5 = e1 - o1;                                                           \
+    c2 = e2 + o2;                                                           \
+    c6 = e2 - o2;                                                           \
+    c3 = e3 + o3;                                                           \
+    c7 = e3 - o3;                                                           \
+}
 
-#define TWIDDLE_FACTOR_MULTIPLICATION(phi, input)                 \
+// w comes from the host twiddle table, see FftPlan
+#define TWIDDLE_FACTOR_MULTIPLICATION(w, input)                   \
 {                                                                 \
-    float2 w, tmp;                                                \
-    w.x = cos(phi);                                               \
-    w.y = sin(phi);                                               \
+    float2 tmp;                                                   \
     tmp.x = (w.x * input.x) - (w.y * input.y);                    \
     tmp.y = (w.x * input.y) + (w.y * input.x);                    \
     input = tmp;                                                  \
 }
 
-kernel void fft()
+// One Stockham stage of radix Ny over a batch of lines: work item (j, line) reads the inputs
+// j + ky * N / Ny, twiddles and transforms them and writes them to n0 + ky * Nx, where
+// n0 = (j - j % Nx) * Ny + j % Nx. Element n of a line is at n * elemStride from its start.
+// The lines of a multichannel buffer (channelCount values per cell, cell-major) go channel by
+// channel: line l starts at (l / channelCount) * lineStride + l % channelCount. lineDim is the
+// NDRange dimension of the lines, 0 when the lines are interleaved (columns, channels) so that
+// neighbouring work items read neighbouring data.
+// The stage twiddles start at twiddleOffset and are Nx blocks of Ny - 1 values.
+// The inverse runs the forward butterflies on conjugated data and scales the last stage by 1/N.
+#define FFT_STAGE_PARAMS            \
+    global const float2 *src,       \
+    global float2 *dst,             \
+    global const float2 *twiddles,  \
+    int twiddleOffset,              \
+    int N,                          \
+    int Nx,                         \
+    int lineDim,                    \
+    int lineStride,                 \
+    int elemStride,                 \
+    int channelCount,               \
+    int inverse,                    \
+    float scale
+
+#define FFT_STAGE_ARGS                                                                    \
+    src, dst, twiddles, twiddleOffset, N, Nx, lineDim, lineStride, elemStride, channelCount, \
+    inverse, scale
+
+// The first stage of a forward transform of real lines, e.g. the channels of the HOG
+// descriptor: src is read as floats with its own strides, dst is written like FFT_STAGE_PARAMS.
+#define FFT_REAL_STAGE_PARAMS       \
+    global const float *src,        \
+    global float2 *dst,             \
+    global const float2 *twiddles,  \
+    int twiddleOffset,              \
+    int N,                          \
+    int Nx,                         \
+    int lineDim,                    \
+    int srcLineStride,              \
+    int srcElemStride,              \
+    int lineStride,                 \
+    int elemStride,                 \
+    int channelCount
+
+#define FFT_REAL_STAGE_ARGS                                                          \
+    src, dst, twiddles, twiddleOffset, N, Nx, lineDim, srcLineStride, srcElemStride, \
+    lineStride, elemStride, channelCount
+
+inline int getLineStart(const int line, const int lineStride, const int channelCount)
+{
+    return (line / channelCount) * lineStride + line % channelCount;
+}
+
+// Twiddles and transforms the Ny inputs of work item j in place
+inline void transformStage(
+    float2 c[8],
+    global const float2 *twiddles,
+    const int j,
+    const int Nx,
+    const int Ny)
+{
+    twiddles += (j % Nx) * (Ny - 1);
+    for (int ky = 1; ky < Ny; ++ky)
+    {
+        TWIDDLE_FACTOR_MULTIPLICATION(twiddles[ky - 1], c[ky]);
+    }
+    switch (Ny)
+    {
+    case 2: DFT_2(c[0], c[1]); break;
+    case 3: DFT_3(c[0], c[1], c[2]); break;
+    case 4: DFT_4(c[0], c[1], c[2], c[3]); break;
+    case 5: DFT_5(c[0], c[1], c[2], c[3], c[4]); break;
+    case 6: DFT_6(c[0], c[1], c[2], c[3], c[4], c[5]); break;
+    case 7: DFT_7(c[0], c[1], c[2], c[3], c[4], c[5], c[6]); break;
+    case 8: DFT_8(c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7]); break;
+    }
+}
+
+inline void calcStage(FFT_STAGE_PARAMS, const int Ny)
+{
+    const int j = get_global_id(1 - lineDim);
+    const int lineStart = getLineStart(get_global_id(lineDim), lineStride, channelCount);
+    const int stride = N / Ny;
+    src += lineStart;
+    dst += lineStart;
+
+    float2 c[8];
+    for (int ky = 0; ky < Ny; ++ky)
+    {
+        c[ky] = src[(j + ky * stride) * elemStride];
+        c[ky].y = inverse ? -c[ky].y : c[ky].y;
+    }
+    transformStage(c, twiddles + twiddleOffset, j, Nx, Ny);
+
+    const int n0 = (j - j % Nx) * Ny + j % Nx;
+    for (int ky = 0; ky < Ny; ++ky)
+    {
+        c[ky].y = inverse ? -c[ky].y : c[ky].y;
+        dst[(n0 + ky * Nx) * elemStride] = scale * c[ky];
+    }
+}
+
+inline void calcRealStage(FFT_REAL_STAGE_PARAMS, const int Ny)
 {
-    /* Init Nx to 1 */
-    uint Nx = 1;
+    const int j = get_global_id(1 - lineDim);
+    const int line = get_global_id(lineDim);
+    const int stride = N / Ny;
+    src += getLineStart(line, srcLineStride, channelCount);
+    dst += getLineStart(line, lineStride, channelCount);
+
+    float2 c[8];
+    for (int ky = 0; ky < Ny; ++ky)
+    {
+        c[ky] = (float2)(src[(j + ky * stride) * srcElemStride], 0.0f);
+    }
+    transformStage(c, twiddles + twiddleOffset, j, Nx, Ny);
 
-    /* Scan each radix stage */
-    for(uint s = 0; s < n_stages; ++s)
+    const int n0 = (j - j % Nx) * Ny + j % Nx;
+    for (int ky = 0; ky < Ny; ++ky)
     {
-         /* Get radix order of stage s */
-         uint Ny = radix[s];
+        dst[(n0 + ky * Nx) * elemStride] = c[ky];
+    }
+}
+
+// One kernel per radix so that the stage loops are unrolled
+kernel void fftStage2(FFT_STAGE_PARAMS) { calcStage(FFT_STAGE_ARGS, 2); }
+kernel void fftStage3(FFT_STAGE_PARAMS) { calcStage(FFT_STAGE_ARGS, 3); }
+kernel void fftStage4(FFT_STAGE_PARAMS) { calcStage(FFT_STAGE_ARGS, 4); }
+kernel void fftStage5(FFT_STAGE_PARAMS) { calcStage(FFT_STAGE_ARGS, 5); }
+kernel void fftStage6(FFT_STAGE_PARAMS) { calcStage(FFT_STAGE_ARGS, 6); }
+kernel void fftStage7(FFT_STAGE_PARAMS) { calcStage(FFT_STAGE_ARGS, 7); }
+kernel void fftStage8(FFT_STAGE_PARAMS) { calcStage(FFT_STAGE_ARGS, 8); }
 
-         /* Body for computing twiddle factor multiplication and radix computation */
-         ...
+kernel void fftRealStage2(FFT_REAL_STAGE_PARAMS) { calcRealStage(FFT_REAL_STAGE_ARGS, 2); }
+kernel void fftRealStage3(FFT_REAL_STAGE_PARAMS) { calcRealStage(FFT_REAL_STAGE_ARGS, 3); }
+kernel void fftRealStage4(FFT_REAL_STAGE_PARAMS) { calcRealStage(FFT_REAL_STAGE_ARGS, 4); }
+kernel void fftRealStage5(FFT_REAL_STAGE_PARAMS) { calcRealStage(FFT_REAL_STAGE_ARGS, 5); }
+kernel void fftRealStage6(FFT_REAL_STAGE_PARAMS) { calcRealStage(FFT_REAL_STAGE_ARGS, 6); }
+kernel void fftRealStage7(FFT_REAL_STAGE_PARAMS) { calcRealStage(FFT_REAL_STAGE_ARGS, 7); }
+kernel void fftRealStage8(FFT_REAL_STAGE_PARAMS) { calcRealStage(FFT_REAL_STAGE_ARGS, 8); }
+
+// Gaussian kernel correlation (see GaussianCorrelation). Per cell: the channel sum of
+// Z_c \cdot \overline{X_c} and the squared magnitudes of both spectra, in one pass.
+kernel void sumChannelProducts(
+    global const float2 *templateSpectrum,
+    global const float2 *imageSpectrum,
+    global float2 *product,
+    global float2 *squaredNorms,
+    const int cellCount,
+    const int channelCount)
+{
+    const int cell = get_global_id(0);
+    if (cell >= cellCount)
+    {
+        return;
+    }
+    templateSpectrum += cell * channelCount;
+    imageSpectrum += cell * channelCount;
+    float2 sum = (float2)(0.0f, 0.0f);
+    float2 norms = (float2)(0.0f, 0.0f);
+    for (int c = 0; c < channelCount; ++c)
+    {
+        const float2 x = templateSpectrum[c];
+        const float2 z = imageSpectrum[c];
+        sum.x += z.x * x.x + z.y * x.y;
+        sum.y += z.y * x.x - z.x * x.y;
+        norms.x += dot(x, x);
+        norms.y += dot(z, z);
+    }
+    product[cell] = sum;
+    squaredNorms[cell] = norms;
+}
 
-         /* Update Nx */
-         Nx *= Ny;
+// Work-item i sums the cells i, i + n, i + 2n... with n the global size
+kernel void sumSquaredNorms(
+    global const float2 *squaredNorms,
+    global float2 *partialNorms,
+    const int cellCount)
+{
+    const int id = get_global_id(0);
+    const int count = get_global_size(0);
+    float2 sum = (float2)(0.0f, 0.0f);
+    for (int cell = id; cell < cellCount; cell += count)
+    {
+        sum += squaredNorms[cell];
     }
+    partialNorms[id] = sum;
 }
 
+// normScale turns the spectral sums into squared norms (Parseval's theorem), scale is
+// -1 / (\sigma^2 \cdot N)
+kernel void mapGaussian(
+    global const float2 *correlation,
+    global const float2 *partialNorms,
+    global float *dst,
+    const int partialCount,
+    const int cellCount,
+    const float normScale,
+    const float scale)
+{
+    const int cell = get_global_id(0);
+    if (cell >= cellCount)
+    {
+        return;
+    }
+    float2 norms = (float2)(0.0f, 0.0f);
+    for (int i = 0; i < partialCount; ++i)
+    {
+        norms += partialNorms[i];
+    }
+    const float distance = fmax(0.0f, (norms.x + norms.y) * normScale - 2.0f * correlation[cell].x);
+    dst[cell] = exp(distance * scale);
+}
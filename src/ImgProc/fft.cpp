@@ -0,0 +1,471 @@
+#include <fft.h>
+
+// Largest divisor of n not above maxSize: the global range must be a multiple of the local one
+static size_t getLocalSize(size_t n, size_t maxSize)
+{
+    size_t localSize = maxSize < n ? maxSize : n;
+    while (n % localSize)
+    {
+        --localSize;
+    }
+    return localSize;
+}
+
+Fft::~Fft()
+{
+    release();
+}
+
+cl_int Fft::initialize(
+    int width,
+    int height,
+    FftPasses passes,
+    bool inverse,
+    cl_context context,
+    cl_program program,
+    cl_mem src)
+{
+    return initializeChannels(width, height, 1, 0, passes, inverse, context, program, src);
+}
+
+cl_int Fft::initializeRealChannels(
+    int width,
+    int height,
+    int channelCount,
+    int cellStride,
+    FftPasses passes,
+    cl_context context,
+    cl_program program,
+    cl_mem src)
+{
+    if (channelCount < 1 || cellStride < channelCount)
+    {
+        return CL_INVALID_VALUE;
+    }
+    return initializeChannels(width, height, channelCount, cellStride, passes, false, context,
+        program, src);
+}
+
+cl_int Fft::initializeChannels(
+    int width,
+    int height,
+    int channelCount,
+    int realCellStride,
+    FftPasses passes,
+    bool inverse,
+    cl_context context,
+    cl_program program,
+    cl_mem src)
+{
+    release();
+    FftPlan rowPlan;
+    FftPlan columnPlan;
+    if (width < 1 || height < 1 || channelCount < 1 ||
+        !rowPlan.init(width, nullptr, FftAlgorithm::stockham) ||
+        (passes == FftPasses::rowsAndColumns &&
+            !columnPlan.init(height, nullptr, FftAlgorithm::stockham)))
+    {
+        return CL_INVALID_VALUE;
+    }
+    int stageCount = rowPlan.stages_.size() + columnPlan.stages_.size();
+    if (stageCount == 0)
+    {
+        return CL_INVALID_VALUE;
+    }
+
+    size_t bytes = width * height * channelCount * sizeof(cl_float2);
+    transformed_ = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+    if (stageCount > 1)
+    {
+        scratch_ = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+    }
+    if (!transformed_ || (stageCount > 1 && !scratch_))
+    {
+        release();
+        return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    }
+
+    // Rows: the channels of a row of cells, columns: the channels of a column
+    const int rowLength = width * channelCount;
+    cl_int status = initializePass(rowPlan, height * channelCount, rowLength, channelCount,
+        channelCount, inverse, context, program, rowTwiddles_, src, realCellStride, stageCount);
+    if (status == CL_SUCCESS && passes == FftPasses::rowsAndColumns)
+    {
+        status = initializePass(columnPlan, width * channelCount, channelCount, rowLength,
+            channelCount, inverse, context, program, columnTwiddles_, src, realCellStride,
+            stageCount);
+    }
+    if (status != CL_SUCCESS)
+    {
+        release();
+    }
+    return status;
+}
+
+cl_int Fft::initializePass(
+    const FftPlan &plan,
+    int lineCount,
+    int lineStride,
+    int elemStride,
+    int channelCount,
+    bool inverse,
+    cl_context context,
+    cl_program program,
+    cl_mem &twiddles,
+    cl_mem &src,
+    int &realCellStride,
+    int &remainingStageCount)
+{
+    if (plan.stages_.empty())
+    {
+        return CL_SUCCESS;
+    }
+    int twiddleCount = 0;
+    int Nx = 1;
+    for (const uint Ny : plan.stages_)
+    {
+        twiddleCount += Nx * (Ny - 1);
+        Nx *= Ny;
+    }
+    twiddles = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+        twiddleCount * sizeof(cl_float2), plan.twiddles_, NULL);
+    if (!twiddles)
+    {
+        return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    }
+
+    static const char *kernelNames[] = { NULL, NULL, "fftStage2", "fftStage3", "fftStage4",
+        "fftStage5", "fftStage6", "fftStage7", "fftStage8" };
+    static const char *realKernelNames[] = { NULL, NULL, "fftRealStage2", "fftRealStage3",
+        "fftRealStage4", "fftRealStage5", "fftRealStage6", "fftRealStage7", "fftRealStage8" };
+    const int N = plan.N_;
+    // Interleaved lines (columns, channels) go along dimension 0 so that the reads coalesce
+    const int lineDim = elemStride == 1 ? 1 : 0;
+    const int inverseArg = inverse ? 1 : 0;
+    int twiddleOffset = 0;
+    Nx = 1;
+    for (const uint stage : plan.stages_)
+    {
+        const int Ny = stage;
+        --remainingStageCount;
+        // Counted from the last stage, which writes transformed_
+        cl_mem dst = remainingStageCount % 2 ? scratch_ : transformed_;
+        const float scale = inverse && Nx * Ny == N ? 1.0f / N : 1.0f;
+
+        RangedKernel kernel;
+        kernel.dim_ = 2;
+        kernel.ndrangeGlob_[lineDim] = lineCount;
+        kernel.ndrangeGlob_[1 - lineDim] = N / Ny;
+        kernel.ndrangeLoc_[0] = getLocalSize(kernel.ndrangeGlob_[0], 64);
+        kernel.ndrangeLoc_[1] = getLocalSize(kernel.ndrangeGlob_[1], 64 / kernel.ndrangeLoc_[0]);
+        kernel.kernel_ = clCreateKernel(program,
+            realCellStride ? realKernelNames[Ny] : kernelNames[Ny], NULL);
+        if (!kernel.kernel_)
+        {
+            return CL_INVALID_KERNEL;
+        }
+        kernels_.push_back(kernel);
+
+        int argId = 0;
+        cl_int status = clSetKernelArg(kernel.kernel_, argId++, sizeof(cl_mem), &src);
+        status |= clSetKernelArg(kernel.kernel_, argId++, sizeof(cl_mem), &dst);
+        status |= clSetKernelArg(kernel.kernel_, argId++, sizeof(cl_mem), &twiddles);
+        status |= clSetKernelArg(kernel.kernel_, argId++, sizeof(cl_int), &twiddleOffset);
+        status |= clSetKernelArg(kernel.kernel_, argId++, sizeof(cl_int), &N);
+        status |= clSetKernelArg(kernel.kernel_, argId++, sizeof(cl_int), &Nx);
+        status |= clSetKernelArg(kernel.kernel_, argId++, sizeof(cl_int), &lineDim);
+        if (realCellStride)
+        {
+            // The same cells, realCellStride floats each
+            const int srcLineStride = lineStride / channelCount * realCellStride;
+            const int srcElemStride = elemStride / channelCount * realCellStride;
+            status |= clSetKernelArg(kernel.kernel_, argId++, sizeof(cl_int), &srcLineStride);
+            status |= clSetKernelArg(kernel.kernel_, argId++, sizeof(cl_int), &srcElemStride);
+        }
+        status |= clSetKernelArg(kernel.kernel_, argId++, sizeof(cl_int), &lineStride);
+        status |= clSetKernelArg(kernel.kernel_, argId++, sizeof(cl_int), &elemStride);
+        status |= clSetKernelArg(kernel.kernel_, argId++, sizeof(cl_int), &channelCount);
+        if (!realCellStride)
+        {
+            status |= clSetKernelArg(kernel.kernel_, argId++, sizeof(cl_int), &inverseArg);
+            status |= clSetKernelArg(kernel.kernel_, argId++, sizeof(cl_float), &scale);
+        }
+        if (status != CL_SUCCESS)
+        {
+            return status;
+        }
+        src = dst;
+        realCellStride = 0;
+        twiddleOffset += Nx * (Ny - 1);
+        Nx *= Ny;
+    }
+    return CL_SUCCESS;
+}
+
+void Fft::release()
+{
+    for (RangedKernel &kernel : kernels_)
+    {
+        kernel.release();
+    }
+    kernels_.clear();
+    if (columnTwiddles_)
+    {
+        clReleaseMemObject(columnTwiddles_);
+        columnTwiddles_ = NULL;
+    }
+    if (rowTwiddles_)
+    {
+        clReleaseMemObject(rowTwiddles_);
+        rowTwiddles_ = NULL;
+    }
+    if (scratch_)
+    {
+        clReleaseMemObject(scratch_);
+        scratch_ = NULL;
+    }
+    if (transformed_)
+    {
+        clReleaseMemObject(transformed_);
+        transformed_ = NULL;
+    }
+}
+
+cl_int Fft::calculate(
+    cl_command_queue queue,
+    cl_int numWaitEvents,
+    const cl_event *waitList,
+    cl_event &event)
+{
+    // Each stage waits for the previous one, the queue being out of order
+    cl_event stageEvent = NULL;
+    cl_int status = CL_SUCCESS;
+    for (size_t i = 0; i < kernels_.size() && status == CL_SUCCESS; ++i)
+    {
+        cl_event waitEvent = stageEvent;
+        stageEvent = NULL;
+        if (waitEvent)
+        {
+            status = kernels_[i].calculate(queue, 1, &waitEvent, stageEvent);
+            clReleaseEvent(waitEvent);
+        }
+        else
+        {
+            status = kernels_[i].calculate(queue, numWaitEvents, waitList, stageEvent);
+        }
+    }
+    if (status != CL_SUCCESS && stageEvent)
+    {
+        clReleaseEvent(stageEvent);
+        stageEvent = NULL;
+    }
+    event = stageEvent;
+    return status;
+}
+
+// Work-items of the norm reduction, each one summing every partialNormCount-th cell
+static const int partialNormCount = 64;
+
+// One work-item per cell, in groups of 64
+static void setCellRange(RangedKernel &kernel, int cellCount)
+{
+    kernel.dim_ = 1;
+    kernel.ndrangeLoc_[0] = 64;
+    kernel.ndrangeGlob_[0] = (cellCount + 63) / 64 * 64;
+}
+
+GaussianCorrelation::~GaussianCorrelation()
+{
+    release();
+}
+
+cl_int GaussianCorrelation::initialize(
+    int width,
+    int height,
+    int channelCount,
+    int cellStride,
+    float sigma,
+    cl_context context,
+    cl_program program,
+    cl_mem templateDescriptor,
+    cl_mem imageDescriptor)
+{
+    release();
+    if (width < 1 || height < 1 || channelCount < 1 || !(sigma > 0.0f))
+    {
+        return CL_INVALID_VALUE;
+    }
+    cl_int status = templateForward_.initializeRealChannels(width, height, channelCount,
+        cellStride, FftPasses::rowsAndColumns, context, program, templateDescriptor);
+    if (status == CL_SUCCESS)
+    {
+        status = imageForward_.initializeRealChannels(width, height, channelCount, cellStride,
+            FftPasses::rowsAndColumns, context, program, imageDescriptor);
+    }
+    if (status != CL_SUCCESS)
+    {
+        release();
+        return status;
+    }
+    const int cellCount = width * height;
+    const size_t bytes = cellCount * sizeof(cl_float2);
+    product_ = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+    squaredNorms_ = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
+    partialNorms_ = clCreateBuffer(context, CL_MEM_READ_WRITE,
+        partialNormCount * sizeof(cl_float2), NULL, NULL);
+    correlation_ = clCreateBuffer(context, CL_MEM_READ_WRITE, cellCount * sizeof(cl_float),
+        NULL, NULL);
+    if (!product_ || !squaredNorms_ || !partialNorms_ || !correlation_)
+    {
+        release();
+        return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    }
+    status = inverse_.initialize(width, height, FftPasses::rowsAndColumns, true, context,
+        program, product_);
+    if (status != CL_SUCCESS)
+    {
+        release();
+        return status;
+    }
+
+    products_.kernel_ = clCreateKernel(program, "sumChannelProducts", NULL);
+    norms_.kernel_ = clCreateKernel(program, "sumSquaredNorms", NULL);
+    gaussian_.kernel_ = clCreateKernel(program, "mapGaussian", NULL);
+    if (!products_.kernel_ || !norms_.kernel_ || !gaussian_.kernel_)
+    {
+        release();
+        return CL_INVALID_KERNEL;
+    }
+    setCellRange(products_, cellCount);
+    setCellRange(gaussian_, cellCount);
+    norms_.dim_ = 1;
+    norms_.ndrangeLoc_[0] = partialNormCount;
+    norms_.ndrangeGlob_[0] = partialNormCount;
+
+    int argId = 0;
+    status = clSetKernelArg(products_.kernel_, argId++, sizeof(cl_mem),
+        &templateForward_.transformed_);
+    status |= clSetKernelArg(products_.kernel_, argId++, sizeof(cl_mem),
+        &imageForward_.transformed_);
+    status |= clSetKernelArg(products_.kernel_, argId++, sizeof(cl_mem), &product_);
+    status |= clSetKernelArg(products_.kernel_, argId++, sizeof(cl_mem), &squaredNorms_);
+    status |= clSetKernelArg(products_.kernel_, argId++, sizeof(cl_int), &cellCount);
+    status |= clSetKernelArg(products_.kernel_, argId++, sizeof(cl_int), &channelCount);
+
+    argId = 0;
+    status |= clSetKernelArg(norms_.kernel_, argId++, sizeof(cl_mem), &squaredNorms_);
+    status |= clSetKernelArg(norms_.kernel_, argId++, sizeof(cl_mem), &partialNorms_);
+    status |= clSetKernelArg(norms_.kernel_, argId++, sizeof(cl_int), &cellCount);
+
+    // The spectral sums are cellCount times the squared norms (Parseval's theorem)
+    const float normScale = 1.0f / cellCount;
+    const float scale = -1.0f / (sigma * sigma * cellCount * channelCount);
+    argId = 0;
+    status |= clSetKernelArg(gaussian_.kernel_, argId++, sizeof(cl_mem), &inverse_.transformed_);
+    status |= clSetKernelArg(gaussian_.kernel_, argId++, sizeof(cl_mem), &partialNorms_);
+    status |= clSetKernelArg(gaussian_.kernel_, argId++, sizeof(cl_mem), &correlation_);
+    status |= clSetKernelArg(gaussian_.kernel_, argId++, sizeof(cl_int), &partialNormCount);
+    status |= clSetKernelArg(gaussian_.kernel_, argId++, sizeof(cl_int), &cellCount);
+    status |= clSetKernelArg(gaussian_.kernel_, argId++, sizeof(cl_float), &normScale);
+    status |= clSetKernelArg(gaussian_.kernel_, argId++, sizeof(cl_float), &scale);
+    if (status != CL_SUCCESS)
+    {
+        release();
+    }
+    return status;
+}
+
+void GaussianCorrelation::release()
+{
+    gaussian_.release();
+    norms_.release();
+    products_.release();
+    inverse_.release();
+    imageForward_.release();
+    templateForward_.release();
+    if (correlation_)
+    {
+        clReleaseMemObject(correlation_);
+        correlation_ = NULL;
+    }
+    if (partialNorms_)
+    {
+        clReleaseMemObject(partialNorms_);
+        partialNorms_ = NULL;
+    }
+    if (squaredNorms_)
+    {
+        clReleaseMemObject(squaredNorms_);
+        squaredNorms_ = NULL;
+    }
+    if (product_)
+    {
+        clReleaseMemObject(product_);
+        product_ = NULL;
+    }
+}
+
+cl_int GaussianCorrelation::calculate(
+    cl_command_queue queue,
+    cl_int numWaitEvents,
+    const cl_event *waitList,
+    cl_event &event,
+    bool templateChanged)
+{
+    // Both forward transforms wait for the caller, the products for both of them
+    cl_event forwardEvents[2] = { NULL, NULL };
+    cl_int forwardCount = 0;
+    cl_int status = CL_SUCCESS;
+    if (templateChanged)
+    {
+        status = templateForward_.calculate(queue, numWaitEvents, waitList,
+            forwardEvents[forwardCount++]);
+    }
+    if (status == CL_SUCCESS)
+    {
+        status = imageForward_.calculate(queue, numWaitEvents, waitList,
+            forwardEvents[forwardCount++]);
+    }
+    cl_event productsEvent = NULL;
+    if (status == CL_SUCCESS)
+    {
+        status = products_.calculate(queue, forwardCount, forwardEvents, productsEvent);
+    }
+    for (cl_event &forwardEvent : forwardEvents)
+    {
+        if (forwardEvent)
+        {
+            clReleaseEvent(forwardEvent);
+            forwardEvent = NULL;
+        }
+    }
+
+    // The norm reduction and the inverse both wait for the products only
+    cl_event waitEvents[2] = { NULL, NULL };
+    if (status == CL_SUCCESS)
+    {
+        status = norms_.calculate(queue, 1, &productsEvent, waitEvents[0]);
+    }
+    if (status == CL_SUCCESS)
+    {
+        status = inverse_.calculate(queue, 1, &productsEvent, waitEvents[1]);
+    }
+    if (productsEvent)
+    {
+        clReleaseEvent(productsEvent);
+        productsEvent = NULL;
+    }
+    if (status == CL_SUCCESS)
+    {
+        status = gaussian_.calculate(queue, 2, waitEvents, event);
+    }
+    for (cl_event &waitEvent : waitEvents)
+    {
+        if (waitEvent)
+        {
+            clReleaseEvent(waitEvent);
+            waitEvent = NULL;
+        }
+    }
+    return status;
+}
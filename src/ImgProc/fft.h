@@ -0,0 +1,137 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <vector>
+#include <fftproto.h>
+#include <rangedkernel.h>
+
+// rows transforms every row of the buffer on its own (a batch of 1D transforms), rowsAndColumns
+// then also every column (the 2D transform).
+enum class FftPasses : int
+{
+    rows = 0,
+    rowsAndColumns
+};
+
+// Mixed-radix transform of a width x height complex buffer (interleaved cl_float2) with the
+// fft.cl kernels, one kernel per Stockham stage. The input is only read: the stages ping-pong
+// between scratch_ and transformed_, the last one writing transformed_. The inverse is scaled
+// by 1 / width (and 1 / height), like FftProto. Both sizes must be radix sizes
+// (isRadixFftSize), there is no Bluestein fallback on the device.
+class Fft
+{
+public:
+    ~Fft();
+    cl_int initialize(
+        int width,
+        int height,
+        FftPasses passes,
+        bool inverse,
+        cl_context context,
+        cl_program program,
+        cl_mem src);
+    // Forward transform of every channel of a real cell-major buffer such as
+    // BlockHog::descriptor_: channel c of cell (x, y) at src[(x + y * width) * cellStride + c].
+    // The first stage reads src as it is, transformed_ then holds channelCount cl_float2 per
+    // cell, channel by channel.
+    cl_int initializeRealChannels(
+        int width,
+        int height,
+        int channelCount,
+        int cellStride,
+        FftPasses passes,
+        cl_context context,
+        cl_program program,
+        cl_mem src);
+    void release();
+    cl_int calculate(
+        cl_command_queue queue,
+        cl_int numWaitEvents,
+        const cl_event *waitList,
+        cl_event &event);
+
+    cl_mem transformed_ = NULL;
+
+protected:
+    // A realCellStride of 0 means a complex src laid out like transformed_
+    cl_int initializeChannels(
+        int width,
+        int height,
+        int channelCount,
+        int realCellStride,
+        FftPasses passes,
+        bool inverse,
+        cl_context context,
+        cl_program program,
+        cl_mem src);
+    // Strides in cl_float2 of transformed_, src and realCellStride move on to the output of
+    // every stage
+    cl_int initializePass(
+        const FftPlan &plan,
+        int lineCount,
+        int lineStride,
+        int elemStride,
+        int channelCount,
+        bool inverse,
+        cl_context context,
+        cl_program program,
+        cl_mem &twiddles,
+        cl_mem &src,
+        int &realCellStride,
+        int &remainingStageCount);
+
+    cl_mem scratch_ = NULL;
+    cl_mem rowTwiddles_ = NULL;
+    cl_mem columnTwiddles_ = NULL;
+    // One per stage in enqueue order, the rows first
+    std::vector<RangedKernel> kernels_;
+};
+
+// Gaussian kernel correlation of a KCF tracker on the device, like
+// FftCorrelationProto::calcGaussian: k = e^{-\max(0, \|x\|^2 + \|z\|^2 - 2 \cdot r) /
+// (\sigma^2 \cdot N)}. Both inputs are real width x height cell descriptors laid out like
+// BlockHog::descriptor_, channelCount of the cellStride floats per cell, so that the HOG of
+// the template and of the frame never leave the device. Their multichannel Fft run side by
+// side, sumChannelProducts then sums the product and the squared magnitudes of the spectra
+// over the channels in one pass, the inverse and the norm reduction run side by side and
+// mapGaussian writes correlation_.
+class GaussianCorrelation
+{
+public:
+    ~GaussianCorrelation();
+    cl_int initialize(
+        int width,
+        int height,
+        int channelCount,
+        int cellStride,
+        float sigma,
+        cl_context context,
+        cl_program program,
+        cl_mem templateDescriptor,
+        cl_mem imageDescriptor);
+    void release();
+    // Without templateChanged the template spectrum of the previous call is reused
+    cl_int calculate(
+        cl_command_queue queue,
+        cl_int numWaitEvents,
+        const cl_event *waitList,
+        cl_event &event,
+        bool templateChanged = true);
+
+    // width x height floats
+    cl_mem correlation_ = NULL;
+
+protected:
+    // One cl_float2 per cell
+    cl_mem product_ = NULL;
+    cl_mem squaredNorms_ = NULL;
+    cl_mem partialNorms_ = NULL;
+    RangedKernel products_;
+    RangedKernel norms_;
+    RangedKernel gaussian_;
+    Fft templateForward_;
+    Fft imageForward_;
+    Fft inverse_;
+};
+
+#endif // FFT_H
@@ -0,0 +1,148 @@
+#include <fftproto.h>
+#include <algorithm>
+#include <xmmintrin.h>
+#include <fftbutterflies.h>
+
+FftBatchProto::~FftBatchProto()
+{
+    release();
+}
+
+void FftBatchProto::release()
+{
+    if (work_)
+    {
+        _mm_free(work_);
+        work_ = nullptr;
+    }
+    laneCount_ = 0U;
+    N_ = 0U;
+    line_.release();
+    plan_.release();
+}
+
+bool FftBatchProto::init(
+    const uint N,
+    const FftAlgorithm algorithm,
+    const uint maxLaneCount,
+    const std::vector<uint> *stages)
+{
+    release();
+    if (maxLaneCount < 4U)
+    {
+        return false;
+    }
+    N_ = N;
+    if (!isRadixFftSize(N))
+    {
+        if (!line_.init(N, stages, algorithm))
+        {
+            return false;
+        }
+        laneCount_ = 1U;
+        work_ = static_cast<float*>(_mm_malloc(2 * N * sizeof(float), 32));
+        if (!work_)
+        {
+            release();
+            return false;
+        }
+        return true;
+    }
+    if (!plan_.init(N, stages, algorithm))
+    {
+        return false;
+    }
+    __builtin_cpu_init();
+    laneCount_ = maxLaneCount >= 8U && __builtin_cpu_supports("avx2") ? 8U : 4U;
+    const uint workLength = 2 * 2 * N * laneCount_;
+    work_ = static_cast<float*>(_mm_malloc(workLength * sizeof(float), 32));
+    if (!work_)
+    {
+        release();
+        return false;
+    }
+    std::fill(work_, work_ + workLength, 0.0f);
+    return true;
+}
+
+bool FftBatchProto::calc(
+    float *data,
+    const uint lineCount,
+    const uint lineStride,
+    const uint elemStride,
+    const bool inverse)
+{
+    return calc(data, lineStride, elemStride, data, lineStride, elemStride, lineCount, inverse);
+}
+
+bool FftBatchProto::calc(
+    const float *src,
+    const uint srcLineStride,
+    const uint srcElemStride,
+    float *dst,
+    const uint dstLineStride,
+    const uint dstElemStride,
+    const uint lineCount,
+    const bool inverse)
+{
+    if (laneCount_ == 1U)
+    {
+        return calcBluesteinLines(src, srcLineStride, srcElemStride, dst, dstLineStride,
+            dstElemStride, lineCount, inverse);
+    }
+    if (laneCount_ == 8U)
+    {
+        return calcLinesAvx2(plan_, src, srcLineStride, srcElemStride, dst, dstLineStride,
+            dstElemStride, lineCount, inverse, work_);
+    }
+    return calcLines<FloatX4, 4U>(plan_, src, srcLineStride, srcElemStride, dst, dstLineStride,
+        dstElemStride, lineCount, inverse, reinterpret_cast<FloatX4*>(work_));
+}
+
+// Contiguous lines go straight through line_, the others are gathered into work_ first.
+// The transform of a line is always complete before it is written, so src may be dst.
+bool FftBatchProto::calcBluesteinLines(
+    const float *src,
+    const uint srcLineStride,
+    const uint srcElemStride,
+    float *dst,
+    const uint dstLineStride,
+    const uint dstElemStride,
+    const uint lineCount,
+    const bool inverse)
+{
+    const uint N = N_;
+    for (uint l = 0; l < lineCount; ++l)
+    {
+        const float *srcLine = src + 2 * l * srcLineStride;
+        float *dstLine = dst + 2 * l * dstLineStride;
+        if (srcElemStride != 1U)
+        {
+            for (uint n = 0; n < N; ++n)
+            {
+                work_[2 * n] = srcLine[2 * n * srcElemStride];
+                work_[2 * n + 1] = srcLine[2 * n * srcElemStride + 1];
+            }
+            srcLine = work_;
+        }
+        if (dstElemStride == 1U)
+        {
+            if (!line_.calc(srcLine, dstLine, inverse))
+            {
+                return false;
+            }
+            continue;
+        }
+        if (!line_.calc(srcLine, inverse))
+        {
+            return false;
+        }
+        const float *result = line_.result();
+        for (uint n = 0; n < N; ++n)
+        {
+            dstLine[2 * n * dstElemStride] = result[2 * n];
+            dstLine[2 * n * dstElemStride + 1] = result[2 * n + 1];
+        }
+    }
+    return true;
+}
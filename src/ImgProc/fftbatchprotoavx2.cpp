@@ -0,0 +1,31 @@
+// Everything below the pragma is compiled for AVX2 and must be called only after a runtime
+// check (see FftBatchProto::init). The standard headers are included before it, so that their
+// inline functions keep the default target.
+#include <algorithm>
+#include <vector>
+#include <fftproto.h>
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+#include <fftbutterflies.h>
+
+typedef float FloatX8 __attribute__((vector_size(32), __may_alias__));
+
+bool calcLinesAvx2(
+    const FftPlan &plan,
+    const float *src,
+    const uint srcLineStride,
+    const uint srcElemStride,
+    float *dst,
+    const uint dstLineStride,
+    const uint dstElemStride,
+    const uint lineCount,
+    const bool inverse,
+    float *work)
+{
+    return calcLines<FloatX8, 8U>(plan, src, srcLineStride, srcElemStride, dst, dstLineStride,
+        dstElemStride, lineCount, inverse, reinterpret_cast<FloatX8*>(work));
+}
+
+#pragma GCC pop_options
@@ -0,0 +1,487 @@
+#ifndef FFTBUTTERFLIES_H
+#define FFTBUTTERFLIES_H
+
+#include <algorithm>
+#include <fftproto.h>
+
+// Radix butterflies and stage loops shared by the scalar and the batched FFT engines. Every
+// template is written for a "lane" type V which is either float or a GCC vector of floats, so
+// the same code transforms one signal or 4 / 8 signals in lockstep (one per vector lane).
+// Translation units which instantiate them with AVX vectors are compiled with the AVX2 target,
+// so nothing but templates may live here.
+
+typedef float FloatX4 __attribute__((vector_size(16), __may_alias__));
+
+template <uint Ny, bool inverse, typename V>
+inline void applyTwiddles(const float *w, V re[8], V im[8])
+{
+    constexpr float sign = inverse ? -1.0f : 1.0f;
+    for (uint ky = 1; ky < Ny; ++ky)
+    {
+        const float wRe = w[2 * (ky - 1U)];
+        const float wIm = w[2 * (ky - 1U) + 1U] * sign;
+        const V tmp = wRe * re[ky] - wIm * im[ky];
+        im[ky] = wRe * im[ky] + wIm * re[ky];
+        re[ky] = tmp;
+    }
+}
+
+template <bool inverse, typename V>
+inline void calcButterfly8(V re[8], V im[8])
+{
+    constexpr float sign = inverse ? -1.0f : 1.0f;
+    constexpr float SQRT2DIV2 = 0.70710678118654f;
+    V v0[2]{ re[0] + re[4], im[0] + im[4] };
+    V v1[2]{ re[0] - re[4], im[0] - im[4] };
+    V v2[2]{ re[1] + re[3], im[1] + im[3] };
+    V v3[2]{ re[1] - re[3], im[1] - im[3] };
+    V v4[2]{ re[2] + re[6], im[2] + im[6] };
+    V v5[2]{ re[2] - re[6], im[2] - im[6] };
+    V v6[2]{ re[5] + re[7], im[5] + im[7] };
+    V v7[2]{ re[5] - re[7], im[5] - im[7] };
+    re[0] = v0[0] + v2[0] + v4[0] + v6[0];
+    im[0] = v0[1] + v2[1] + v4[1] + v6[1];
+    re[4] = v0[0] - v2[0] + v4[0] - v6[0];
+    im[4] = v0[1] - v2[1] + v4[1] - v6[1];
+    re[2] = v0[0] - v4[0] + (v3[1] + v7[1]) * sign;
+    im[2] = v0[1] - v4[1] - (v3[0] + v7[0]) * sign;
+    re[6] = v0[0] - v4[0] - (v3[1] + v7[1]) * sign;
+    im[6] = v0[1] - v4[1] + (v3[0] + v7[0]) * sign;
+    for (uint i = 0; i < 2; ++i)
+    {
+        v2[i] *= SQRT2DIV2;
+        v3[i] *= SQRT2DIV2;
+        v6[i] *= SQRT2DIV2;
+        v7[i] *= SQRT2DIV2;
+    }
+    re[1] = v1[0] + v3[0] - v7[0] + (v2[1] + v5[1] - v6[1]) * sign;
+    im[1] = v1[1] + v3[1] - v7[1] - (v2[0] + v5[0] - v6[0]) * sign;
+    re[3] = v1[0] - v3[0] + v7[0] + (v2[1] - v5[1] - v6[1]) * sign;
+    im[3] = v1[1] - v3[1] + v7[1] - (v2[0] - v5[0] - v6[0]) * sign;
+    re[5] = v1[0] - v3[0] + v7[0] - (v2[1] - v5[1] - v6[1]) * sign;
+    im[5] = v1[1] - v3[1] + v7[1] + (v2[0] - v5[0] - v6[0]) * sign;
+    re[7] = v1[0] + v3[0] - v7[0] - (v2[1] + v5[1] - v6[1]) * sign;
+    im[7] = v1[1] + v3[1] - v7[1] + (v2[0] + v5[0] - v6[0]) * sign;
+}
+
+template <bool inverse, typename V>
+inline void calcButterfly7(V re[8], V im[8])
+{
+    constexpr float sign = inverse ? -1.0f : 1.0f;
+    constexpr float W7A = 0.62348980185873f;
+    constexpr float W7B = 0.78183148246802f * sign;
+    constexpr float W7C = 0.22252093395631f;
+    constexpr float W7D = 0.97492791218182f * sign;
+    constexpr float W7E = 0.90096886790241f;
+    constexpr float W7F = 0.43388373911755f * sign;
+    const V s16[2]{ re[1] + re[6], im[1] + im[6] };
+    const V d16[2]{ re[1] - re[6], im[1] - im[6] };
+    const V s25[2]{ re[2] + re[5], im[2] + im[5] };
+    const V d25[2]{ re[2] - re[5], im[2] - im[5] };
+    const V s34[2]{ re[3] + re[4], im[3] + im[4] };
+    const V d34[2]{ re[3] - re[4], im[3] - im[4] };
+    const V v0[2]{ re[0], im[0] };
+    const V v1[2]{ W7A * s16[0] - W7C * s25[0] - W7E * s34[0],
+        W7A * s16[1] - W7C * s25[1] - W7E * s34[1] };
+    const V v2[2]{ W7C * s16[0] + W7E * s25[0] - W7A * s34[0],
+        W7C * s16[1] + W7E * s25[1] - W7A * s34[1] };
+    const V v3[2]{ W7E * s16[0] - W7A * s25[0] + W7C * s34[0],
+        W7E * s16[1] - W7A * s25[1] + W7C * s34[1] };
+    const V v4[2]{ W7B * d16[0] + W7D * d25[0] + W7F * d34[0],
+        W7B * d16[1] + W7D * d25[1] + W7F * d34[1] };
+    const V v5[2]{ W7D * d16[0] - W7F * d25[0] - W7B * d34[0],
+        W7D * d16[1] - W7F * d25[1] - W7B * d34[1] };
+    const V v6[2]{ W7F * d16[0] - W7B * d25[0] + W7D * d34[0],
+        W7F * d16[1] - W7B * d25[1] + W7D * d34[1] };
+    re[0] = v0[0] + s16[0] + s25[0] + s34[0];
+    im[0] = v0[1] + s16[1] + s25[1] + s34[1];
+    re[1] = v0[0] + v1[0] + v4[1];
+    im[1] = v0[1] + v1[1] - v4[0];
+    re[2] = v0[0] - v2[0] + v5[1];
+    im[2] = v0[1] - v2[1] - v5[0];
+    re[3] = v0[0] - v3[0] + v6[1];
+    im[3] = v0[1] - v3[1] - v6[0];
+    re[4] = v0[0] - v3[0] - v6[1];
+    im[4] = v0[1] - v3[1] + v6[0];
+    re[5] = v0[0] - v2[0] - v5[1];
+    im[5] = v0[1] - v2[1] + v5[0];
+    re[6] = v0[0] + v1[0] - v4[1];
+    im[6] = v0[1] + v1[1] + v4[0];
+}
+
+template <bool inverse, typename V>
+inline void calcButterfly6(V re[8], V im[8])
+{
+    constexpr float sign = inverse ? -1.0f : 1.0f;
+    constexpr float SQRT3DIV2 = 0.86602540378443f * sign;
+    const V v0[2]{ re[0] + re[3], im[0] + im[3] };
+    const V v1[2]{ re[0] - re[3], im[0] - im[3] };
+    const V v2[2]{ re[1] + re[2], im[1] + im[2] };
+    const V v3[2]{ re[1] - re[2], im[1] - im[2] };
+    const V v4[2]{ re[4] + re[5], im[4] + im[5] };
+    const V v5[2]{ re[4] - re[5], im[4] - im[5] };
+    re[0] = v0[0] + v2[0] + v4[0];
+    im[0] = v0[1] + v2[1] + v4[1];
+    re[3] = v1[0] - v3[0] + v5[0];
+    im[3] = v1[1] - v3[1] + v5[1];
+    re[1] = v1[0] + (v3[0] - v5[0]) * 0.5f - (v4[1] - v2[1]) * SQRT3DIV2;
+    im[1] = v1[1] + (v3[1] - v5[1]) * 0.5f + (v4[0] - v2[0]) * SQRT3DIV2;
+    re[2] = v0[0] - (v2[0] + v4[0]) * 0.5f + (v3[1] + v5[1]) * SQRT3DIV2;
+    im[2] = v0[1] - (v2[1] + v4[1]) * 0.5f - (v3[0] + v5[0]) * SQRT3DIV2;
+    re[4] = v0[0] - (v2[0] + v4[0]) * 0.5f - (v3[1] + v5[1]) * SQRT3DIV2;
+    im[4] = v0[1] - (v2[1] + v4[1]) * 0.5f + (v3[0] + v5[0]) * SQRT3DIV2;
+    re[5] = v1[0] + (v3[0] - v5[0]) * 0.5f - (v2[1] - v4[1]) * SQRT3DIV2;
+    im[5] = v1[1] + (v3[1] - v5[1]) * 0.5f + (v2[0] - v4[0]) * SQRT3DIV2;
+}
+
+template <bool inverse, typename V>
+inline void calcButterfly5(V re[8], V im[8])
+{
+    constexpr float sign = inverse ? -1.0f : 1.0f;
+    constexpr float W5A = 0.30901699437494f;
+    constexpr float W5B = 0.95105651629515f * sign;
+    constexpr float W5C = 0.80901699437494f;
+    constexpr float W5D = 0.58778525229247f * sign;
+    const V s14[2]{ re[1] + re[4], im[1] + im[4] };
+    const V d14[2]{ re[1] - re[4], im[1] - im[4] };
+    const V s23[2]{ re[2] + re[3], im[2] + im[3] };
+    const V d23[2]{ re[2] - re[3], im[2] - im[3] };
+    const V v0[2]{ re[0], im[0] };
+    const V v1[2]{ W5A * s14[0] - W5C * s23[0], W5A * s14[1] - W5C * s23[1] };
+    const V v2[2]{ W5C * s14[0] - W5A * s23[0], W5C * s14[1] - W5A * s23[1] };
+    const V v3[2]{ W5D * d14[0] - W5B * d23[0], W5D * d14[1] - W5B * d23[1] };
+    const V v4[2]{ W5B * d14[0] + W5D * d23[0], W5B * d14[1] + W5D * d23[1] };
+    re[0] = v0[0] + s14[0] + s23[0];
+    im[0] = v0[1] + s14[1] + s23[1];
+    re[1] = v0[0] + v1[0] + v4[1];
+    im[1] = v0[1] + v1[1] - v4[0];
+    re[2] = v0[0] - v2[0] + v3[1];
+    im[2] = v0[1] - v2[1] - v3[0];
+    re[3] = v0[0] - v2[0] - v3[1];
+    im[3] = v0[1] - v2[1] + v3[0];
+    re[4] = v0[0] + v1[0] - v4[1];
+    im[4] = v0[1] + v1[1] + v4[0];
+}
+
+template <bool inverse, typename V>
+inline void calcButterfly4(V re[8], V im[8])
+{
+    constexpr float sign = inverse ? -1.0f : 1.0f;
+    const V v3[2]{ (im[1] - im[3]) * sign, (re[3] - re[1]) * sign };
+    V *x[2]{ re, im };
+    for (uint i = 0; i < 2; ++i)
+    {
+        const V v0 = x[i][0] + x[i][2];
+        const V v1 = x[i][1] + x[i][3];
+        const V v2 = x[i][0] - x[i][2];
+        x[i][0] = v0 + v1;
+        x[i][2] = v0 - v1;
+        x[i][1] = v2 + v3[i];
+        x[i][3] = v2 - v3[i];
+    }
+}
+
+template <bool inverse, typename V>
+inline void calcButterfly3(V re[8], V im[8])
+{
+    constexpr float sign = inverse ? -1.0f : 1.0f;
+    constexpr float SQRT3DIV2 = 0.86602540378443f * sign;
+    const V v0[2]{ re[1] + re[2], im[1] + im[2] };
+    const V v1[2]{ re[1] - re[2], im[1] - im[2] };
+    re[1] = re[0] - 0.5f * v0[0] + v1[1] * SQRT3DIV2;
+    im[1] = im[0] - 0.5f * v0[1] - v1[0] * SQRT3DIV2;
+    re[2] = re[0] - 0.5f * v0[0] - v1[1] * SQRT3DIV2;
+    im[2] = im[0] - 0.5f * v0[1] + v1[0] * SQRT3DIV2;
+    re[0] = re[0] + v0[0];
+    im[0] = im[0] + v0[1];
+}
+
+template <typename V>
+inline void calcButterfly2(V re[8], V im[8])
+{
+    const V v[2]{ re[0], im[0] };
+    re[0] = v[0] + re[1];
+    im[0] = v[1] + im[1];
+    re[1] = v[0] - re[1];
+    im[1] = v[1] - im[1];
+}
+
+// Radix computation of a single butterfly, in place. Ny is a template argument, so the switch
+// is resolved at compile time.
+template <uint Ny, bool inverse, typename V>
+inline void calcButterfly(V re[8], V im[8])
+{
+    switch (Ny)
+    {
+    case 8U:
+        calcButterfly8<inverse>(re, im);
+        break;
+    case 7U:
+        calcButterfly7<inverse>(re, im);
+        break;
+    case 6U:
+        calcButterfly6<inverse>(re, im);
+        break;
+    case 5U:
+        calcButterfly5<inverse>(re, im);
+        break;
+    case 4U:
+        calcButterfly4<inverse>(re, im);
+        break;
+    case 3U:
+        calcButterfly3<inverse>(re, im);
+        break;
+    case 2U:
+        calcButterfly2(re, im);
+        break;
+    }
+}
+
+// Codelets: the loops of one stage specialised for its radix and direction, so the loads, the
+// twiddles and the butterfly unroll completely. Element n of a signal is at re[n * step] and
+// im[n * step]: step is 1 for the lane buffers (N vectors of real parts followed by N vectors of
+// imaginary parts) and 2 for interleaved complex floats.
+
+// In-place stage over a buffer in digit-reversed order (see FftProto::calcRadixStages)
+template <uint Ny, bool inverse>
+struct RadixStage
+{
+    template <typename V, uint step>
+    static void calc(const uint N, const uint Nx, const float *twiddles, V *re, V *im)
+    {
+        V xRe[8];
+        V xIm[8];
+        const uint Ni = Nx * Ny;
+        for (uint nx = 0; nx < Nx; ++nx)
+        {
+            const float *w = twiddles + 2 * nx * (Ny - 1U);
+            for (uint n = nx; n < N; n += Ni)
+            {
+                for (uint ky = 0; ky < Ny; ++ky)
+                {
+                    xRe[ky] = re[(n + ky * Nx) * step];
+                    xIm[ky] = im[(n + ky * Nx) * step];
+                }
+                applyTwiddles<Ny, inverse>(w, xRe, xIm);
+                calcButterfly<Ny, inverse>(xRe, xIm);
+                for (uint ky = 0; ky < Ny; ++ky)
+                {
+                    re[(n + ky * Nx) * step] = xRe[ky];
+                    im[(n + ky * Nx) * step] = xIm[ky];
+                }
+            }
+        }
+    }
+};
+
+// Out-of-place Stockham stage (see FftProto::calcStockham)
+template <uint Ny, bool inverse>
+struct StockhamStage
+{
+    template <typename V, uint step>
+    static void calc(
+        const uint N,
+        const uint Nx,
+        const float *twiddles,
+        const V *srcRe,
+        const V *srcIm,
+        V *dstRe,
+        V *dstIm)
+    {
+        V xRe[8];
+        V xIm[8];
+        const uint Ni = Nx * Ny;
+        const uint stride = N / Ny;
+        for (uint j0 = 0, n0 = 0; j0 < stride; j0 += Nx, n0 += Ni)
+        {
+            for (uint nx = 0; nx < Nx; ++nx)
+            {
+                for (uint ky = 0; ky < Ny; ++ky)
+                {
+                    xRe[ky] = srcRe[(j0 + nx + ky * stride) * step];
+                    xIm[ky] = srcIm[(j0 + nx + ky * stride) * step];
+                }
+                applyTwiddles<Ny, inverse>(twiddles + 2 * nx * (Ny - 1U), xRe, xIm);
+                calcButterfly<Ny, inverse>(xRe, xIm);
+                for (uint ky = 0; ky < Ny; ++ky)
+                {
+                    dstRe[(n0 + nx + ky * Nx) * step] = xRe[ky];
+                    dstIm[(n0 + nx + ky * Nx) * step] = xIm[ky];
+                }
+            }
+        }
+    }
+};
+
+// Picks the codelet of a stage: the only place where the radix and the direction are tested
+template <template <uint, bool> class Stage, typename V, uint step, typename... Args>
+inline bool calcStage(const uint Ny, const bool inverse, Args... args)
+{
+    switch (Ny)
+    {
+    case 8U:
+        inverse ? Stage<8U, true>::template calc<V, step>(args...) :
+            Stage<8U, false>::template calc<V, step>(args...);
+        return true;
+    case 7U:
+        inverse ? Stage<7U, true>::template calc<V, step>(args...) :
+            Stage<7U, false>::template calc<V, step>(args...);
+        return true;
+    case 6U:
+        inverse ? Stage<6U, true>::template calc<V, step>(args...) :
+            Stage<6U, false>::template calc<V, step>(args...);
+        return true;
+    case 5U:
+        inverse ? Stage<5U, true>::template calc<V, step>(args...) :
+            Stage<5U, false>::template calc<V, step>(args...);
+        return true;
+    case 4U:
+        inverse ? Stage<4U, true>::template calc<V, step>(args...) :
+            Stage<4U, false>::template calc<V, step>(args...);
+        return true;
+    case 3U:
+        inverse ? Stage<3U, true>::template calc<V, step>(args...) :
+            Stage<3U, false>::template calc<V, step>(args...);
+        return true;
+    case 2U:
+        inverse ? Stage<2U, true>::template calc<V, step>(args...) :
+            Stage<2U, false>::template calc<V, step>(args...);
+        return true;
+    }
+    return false;
+}
+
+// All the in-place stages of the digit-reversal engine
+template <typename V, uint step>
+bool calcRadixStages(const FftPlan &plan, const bool inverse, V *re, V *im)
+{
+    const float *twiddles = plan.twiddles_;
+    uint Nx = 1U;
+    for (const uint Ny : plan.stages_)
+    {
+        if (!calcStage<RadixStage, V, step>(Ny, inverse, plan.N_, Nx, twiddles, re, im))
+        {
+            return false;
+        }
+        twiddles += 2 * Nx * (Ny - 1U);
+        Nx *= Ny;
+    }
+    return true;
+}
+
+// All the Stockham stages: the first one reads src, then they ping-pong between the buffers 0
+// and 1, starting with 0. The result lands in buffer 0 for an odd number of stages and in
+// buffer 1 otherwise. src may be buffer 1.
+template <typename V, uint step>
+bool calcStockhamStages(
+    const FftPlan &plan,
+    const bool inverse,
+    const V *srcRe,
+    const V *srcIm,
+    V *re0,
+    V *im0,
+    V *re1,
+    V *im1)
+{
+    const float *twiddles = plan.twiddles_;
+    uint Nx = 1U;
+    V *dstRe = re0;
+    V *dstIm = im0;
+    for (const uint Ny : plan.stages_)
+    {
+        if (!calcStage<StockhamStage, V, step>(Ny, inverse, plan.N_, Nx, twiddles, srcRe, srcIm,
+                dstRe, dstIm))
+        {
+            return false;
+        }
+        twiddles += 2 * Nx * (Ny - 1U);
+        Nx *= Ny;
+        srcRe = dstRe;
+        srcIm = dstIm;
+        dstRe = dstRe == re0 ? re1 : re0;
+        dstIm = dstIm == im0 ? im1 : im0;
+    }
+    return true;
+}
+
+// Transforms lineCount lines of a complex buffer: element n of line l is read from
+// src[2 * (l * srcLineStride + n * srcElemStride)] and written to dst the same way with the dst
+// strides. Lines are gathered in groups of laneCount into the lane buffers (two buffers of
+// 2 * N vectors in work), transformed and scattered. A group is gathered completely before it
+// is scattered, so src may be dst with the same strides. The digit-reversal permutation is
+// applied during the gather for free.
+template <typename V, uint laneCount>
+bool calcLines(
+    const FftPlan &plan,
+    const float *src,
+    const uint srcLineStride,
+    const uint srcElemStride,
+    float *dst,
+    const uint dstLineStride,
+    const uint dstElemStride,
+    const uint lineCount,
+    const bool inverse,
+    V *work)
+{
+    const uint N = plan.N_;
+    const float scale = inverse ? 1.0f / N : 1.0f;
+    for (uint line0 = 0; line0 < lineCount; line0 += laneCount)
+    {
+        const uint lanes = std::min(laneCount, lineCount - line0);
+        const float *srcLines = src + 2 * line0 * srcLineStride;
+        float *dstLines = dst + 2 * line0 * dstLineStride;
+        float *gathered = reinterpret_cast<float*>(work);
+        for (uint n = 0; n < N; ++n)
+        {
+            const uint k = plan.digitReversal_ ? plan.digitReversal_[n] : n;
+            const float *x = srcLines + 2 * k * srcElemStride;
+            for (uint l = 0; l < lanes; ++l)
+            {
+                gathered[n * laneCount + l] = x[2 * l * srcLineStride];
+                gathered[(N + n) * laneCount + l] = x[2 * l * srcLineStride + 1];
+            }
+        }
+        const uint stageCount = plan.stages_.size();
+        const V *result = work;
+        if (plan.algorithm_ == FftAlgorithm::stockham)
+        {
+            V *buf = work + 2 * N;
+            if (!calcStockhamStages<V, 1U>(plan, inverse, work, work + N, buf, buf + N, work,
+                    work + N))
+            {
+                return false;
+            }
+            result = stageCount % 2U ? buf : work;
+        }
+        else if (!calcRadixStages<V, 1U>(plan, inverse, work, work + N))
+        {
+            return false;
+        }
+        const float *scattered = reinterpret_cast<const float*>(result);
+        for (uint n = 0; n < N; ++n)
+        {
+            float *X = dstLines + 2 * n * dstElemStride;
+            for (uint l = 0; l < lanes; ++l)
+            {
+                X[2 * l * dstLineStride] = scattered[n * laneCount + l] * scale;
+                X[2 * l * dstLineStride + 1] = scattered[(N + n) * laneCount + l] * scale;
+            }
+        }
+    }
+    return true;
+}
+
+// Defined in fftbatchprotoavx2.cpp, which is compiled for the AVX2 target
+bool calcLinesAvx2(
+    const FftPlan &plan,
+    const float *src,
+    const uint srcLineStride,
+    const uint srcElemStride,
+    float *dst,
+    const uint dstLineStride,
+    const uint dstElemStride,
+    const uint lineCount,
+    const bool inverse,
+    float *work);
+
+#endif // FFTBUTTERFLIES_H
@@ -0,0 +1,382 @@
+#include <fftcorrelationproto.h>
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+
+FftCorrelationProto::~FftCorrelationProto()
+{
+    release();
+}
+
+void FftCorrelationProto::release()
+{
+    if (dstReal_)
+    {
+        delete [] dstReal_;
+        dstReal_ = nullptr;
+    }
+    if (cropped_)
+    {
+        delete [] cropped_;
+        cropped_ = nullptr;
+    }
+    if (product_)
+    {
+        delete [] product_;
+        product_ = nullptr;
+    }
+    if (templateSpectrum_)
+    {
+        delete [] templateSpectrum_;
+        templateSpectrum_ = nullptr;
+    }
+    if (tile_)
+    {
+        delete [] tile_;
+        tile_ = nullptr;
+    }
+    inverse_.release();
+    forward_.release();
+    overlapSave_ = false;
+}
+
+bool FftCorrelationProto::init(
+    const uint width,
+    const uint height,
+    const uint channelCount,
+    const FftAlgorithm algorithm)
+{
+    release();
+    imageWidth_ = templateWidth_ = tileWidth_ = resultWidth_ = width;
+    imageHeight_ = templateHeight_ = tileHeight_ = resultHeight_ = height;
+    channelCount_ = channelCount;
+    return initTiles(algorithm);
+}
+
+// Radix tile sizes from the template size up to the first one which covers the frame. A
+// frame takes ceil(r / (B - t + 1)) tiles along each axis, r being the response count along
+// it, and a tile costs about B_x \cdot B_y \cdot \log_2(B_x \cdot B_y).
+bool FftCorrelationProto::initOverlapSave(
+    const uint frameWidth,
+    const uint frameHeight,
+    const uint templateWidth,
+    const uint templateHeight,
+    const uint channelCount,
+    const uint tileWidth,
+    const uint tileHeight,
+    const FftAlgorithm algorithm)
+{
+    release();
+    if (!templateWidth || !templateHeight || templateWidth > frameWidth ||
+        templateHeight > frameHeight)
+    {
+        return false;
+    }
+    overlapSave_ = true;
+    imageWidth_ = frameWidth;
+    imageHeight_ = frameHeight;
+    templateWidth_ = templateWidth;
+    templateHeight_ = templateHeight;
+    channelCount_ = channelCount;
+    resultWidth_ = frameWidth - templateWidth + 1U;
+    resultHeight_ = frameHeight - templateHeight + 1U;
+    tileWidth_ = tileWidth;
+    tileHeight_ = tileHeight;
+    if (!tileWidth_ || !tileHeight_)
+    {
+        const uint maxWidth = getNextRadixFftSize(frameWidth);
+        const uint maxHeight = getNextRadixFftSize(frameHeight);
+        double bestCost = -1.0;
+        for (uint w = getNextRadixFftSize(templateWidth); w <= maxWidth;
+             w = getNextRadixFftSize(w + 1U))
+        {
+            for (uint h = getNextRadixFftSize(templateHeight); h <= maxHeight;
+                 h = getNextRadixFftSize(h + 1U))
+            {
+                const uint stepX = w - templateWidth + 1U;
+                const uint stepY = h - templateHeight + 1U;
+                const uint tileCount = ((resultWidth_ + stepX - 1U) / stepX) *
+                    ((resultHeight_ + stepY - 1U) / stepY);
+                const double cost = tileCount * w * h * std::log2(static_cast<double>(w) * h);
+                if (bestCost < 0.0 || cost < bestCost)
+                {
+                    bestCost = cost;
+                    tileWidth_ = w;
+                    tileHeight_ = h;
+                }
+            }
+        }
+    }
+    if (tileWidth_ < templateWidth_ || tileHeight_ < templateHeight_)
+    {
+        return false;
+    }
+    return initTiles(algorithm);
+}
+
+bool FftCorrelationProto::initTiles(const FftAlgorithm algorithm)
+{
+    if (!channelCount_ || !forward_.init(tileWidth_, tileHeight_, channelCount_, algorithm) ||
+        !inverse_.init(tileWidth_, tileHeight_, algorithm))
+    {
+        return false;
+    }
+    const uint cellCount = tileWidth_ * tileHeight_;
+    tile_ = new float [cellCount * channelCount_];
+    std::fill(tile_, tile_ + cellCount * channelCount_, 0.0f);
+    templateSpectrum_ = new float [2 * cellCount * channelCount_];
+    std::fill(templateSpectrum_, templateSpectrum_ + 2 * cellCount * channelCount_, 0.0f);
+    product_ = new float [2 * cellCount];
+    std::fill(product_, product_ + 2 * cellCount, 0.0f);
+    if (overlapSave_)
+    {
+        const uint croppedLength = 2 * (tileWidth_ - templateWidth_ + 1U) *
+            (tileHeight_ - templateHeight_ + 1U);
+        cropped_ = new float [croppedLength];
+        std::fill(cropped_, cropped_ + croppedLength, 0.0f);
+    }
+    dstReal_ = new float [resultWidth_ * resultHeight_];
+    std::fill(dstReal_, dstReal_ + resultWidth_ * resultHeight_, 0.0f);
+    return true;
+}
+
+bool FftCorrelationProto::setTemplate(const float *templ, const uint cellStride)
+{
+    if (!tile_ || cellStride < channelCount_)
+    {
+        return false;
+    }
+    std::fill(tile_, tile_ + tileWidth_ * tileHeight_ * channelCount_, 0.0f);
+    for (uint y = 0; y < templateHeight_; ++y)
+    {
+        for (uint x = 0; x < templateWidth_; ++x)
+        {
+            const float *src = templ + (x + y * templateWidth_) * cellStride;
+            std::copy(src, src + channelCount_, tile_ + (x + y * tileWidth_) * channelCount_);
+        }
+    }
+    if (!forward_.calcForward(tile_, channelCount_))
+    {
+        return false;
+    }
+    const float *spectrum = forward_.result();
+    const uint length = 2 * tileWidth_ * tileHeight_ * channelCount_;
+    std::copy(spectrum, spectrum + length, templateSpectrum_);
+    double squaredNorm = 0.0;
+    for (uint i = 0; i < length; ++i)
+    {
+        squaredNorm += spectrum[i] * spectrum[i];
+    }
+    templateSquaredNorm_ = squaredNorm / (tileWidth_ * tileHeight_);
+    return true;
+}
+
+bool FftCorrelationProto::calc(const float *image, const uint cellStride)
+{
+    if (!tile_ || cellStride < channelCount_)
+    {
+        return false;
+    }
+    return overlapSave_ ? calcOverlapSave(image, cellStride) : calcCircular(image, cellStride);
+}
+
+const float* FftCorrelationProto::result() const
+{
+    return dstReal_;
+}
+
+void FftCorrelationProto::loadTile(
+    const float *image,
+    const uint cellStride,
+    const uint x0,
+    const uint y0)
+{
+    const uint C = channelCount_;
+    const uint width = std::min(tileWidth_, imageWidth_ - x0);
+    const uint height = std::min(tileHeight_, imageHeight_ - y0);
+    for (uint y = 0; y < height; ++y)
+    {
+        const float *src = image + (x0 + (y0 + y) * imageWidth_) * cellStride;
+        float *dst = tile_ + y * tileWidth_ * C;
+        for (uint x = 0; x < width; ++x)
+        {
+            std::copy(src + x * cellStride, src + x * cellStride + C, dst + x * C);
+        }
+        std::fill(dst + width * C, dst + tileWidth_ * C, 0.0f);
+    }
+    std::fill(tile_ + height * tileWidth_ * C, tile_ + tileHeight_ * tileWidth_ * C, 0.0f);
+}
+
+// (x_r + i \cdot x_i) \cdot (t_r - i \cdot t_i) = x_r \cdot t_r + x_i \cdot t_i +
+// i \cdot (x_i \cdot t_r - x_r \cdot t_i), summed over the channels of a cell. Two channels
+// per SSE register (x_{r0}, x_{i0}, x_{r1}, x_{i1}): X \cdot T sums to the real part and
+// X \cdot T with t_r and t_i swapped gives (x_r \cdot t_i, x_i \cdot t_r) pairs, whose
+// differences sum to the imaginary part.
+double FftCorrelationProto::multiplySpectra(const bool imaginary)
+{
+    const uint C = channelCount_;
+    const uint pairCount = C / 2U;
+    const float *X = forward_.result();
+    const float *T = templateSpectrum_;
+    double squaredNorm = 0.0;
+    for (uint i = 0; i < tileWidth_ * tileHeight_; ++i)
+    {
+        const float *x = X + 2 * i * C;
+        const float *t = T + 2 * i * C;
+        __m128 real = _mm_setzero_ps();
+        __m128 cross = _mm_setzero_ps();
+        __m128 norm = _mm_setzero_ps();
+        for (uint p = 0; p < pairCount; ++p)
+        {
+            const __m128 xv = _mm_loadu_ps(x + 4 * p);
+            const __m128 tv = _mm_loadu_ps(t + 4 * p);
+            real = _mm_add_ps(real, _mm_mul_ps(xv, tv));
+            cross = _mm_add_ps(cross,
+                _mm_mul_ps(xv, _mm_shuffle_ps(tv, tv, _MM_SHUFFLE(2, 3, 0, 1))));
+            norm = _mm_add_ps(norm, _mm_mul_ps(xv, xv));
+        }
+        float sums[3][4];
+        _mm_storeu_ps(sums[0], real);
+        _mm_storeu_ps(sums[1], cross);
+        _mm_storeu_ps(sums[2], norm);
+        float re = sums[0][0] + sums[0][1] + sums[0][2] + sums[0][3];
+        float im = sums[1][1] - sums[1][0] + sums[1][3] - sums[1][2];
+        float cellNorm = sums[2][0] + sums[2][1] + sums[2][2] + sums[2][3];
+        if (C % 2U)
+        {
+            const float xr = x[2 * (C - 1U)];
+            const float xi = x[2 * (C - 1U) + 1];
+            const float tr = t[2 * (C - 1U)];
+            const float ti = t[2 * (C - 1U) + 1];
+            re += xr * tr + xi * ti;
+            im += xi * tr - xr * ti;
+            cellNorm += xr * xr + xi * xi;
+        }
+        squaredNorm += cellNorm;
+        if (imaginary)
+        {
+            product_[2 * i] -= im;
+            product_[2 * i + 1] += re;
+        }
+        else
+        {
+            product_[2 * i] = re;
+            product_[2 * i + 1] = im;
+        }
+    }
+    return squaredNorm;
+}
+
+bool FftCorrelationProto::calcCircular(const float *image, const uint cellStride)
+{
+    if (!forward_.calcForward(image, cellStride))
+    {
+        return false;
+    }
+    multiplySpectra(false);
+    if (!inverse_.calc(product_, tileWidth_, product_, tileWidth_, true))
+    {
+        return false;
+    }
+    for (uint i = 0; i < resultWidth_ * resultHeight_; ++i)
+    {
+        dstReal_[i] = product_[2 * i];
+    }
+    return true;
+}
+
+bool FftCorrelationProto::calcGaussian(
+    const float *image,
+    const uint cellStride,
+    const float sigma)
+{
+    if (!tile_ || overlapSave_ || cellStride < channelCount_ || sigma <= 0.0f ||
+        !forward_.calcForward(image, cellStride))
+    {
+        return false;
+    }
+    const uint cellCount = tileWidth_ * tileHeight_;
+    const double imageSquaredNorm = multiplySpectra(false) / cellCount;
+    if (!inverse_.calc(product_, tileWidth_, product_, tileWidth_, true))
+    {
+        return false;
+    }
+    const float squaredNorms = static_cast<float>(templateSquaredNorm_ + imageSquaredNorm);
+    const float scale = -1.0f / (sigma * sigma * cellCount * channelCount_);
+    for (uint i = 0; i < cellCount; ++i)
+    {
+        const float distance = std::max(0.0f, squaredNorms - 2.0f * product_[2 * i]);
+        dstReal_[i] = std::exp(distance * scale);
+    }
+    return true;
+}
+
+// Response (x, y) of a tile at (x0, y0) does not wrap around for x <= B_x - t_x and
+// y <= B_y - t_y, so consecutive tiles are B - t + 1 apart. Only these responses are computed
+// by the pruned inverse.
+bool FftCorrelationProto::calcOverlapSave(const float *image, const uint cellStride)
+{
+    const uint stepX = tileWidth_ - templateWidth_ + 1U;
+    const uint stepY = tileHeight_ - templateHeight_ + 1U;
+    const FftRect output{ 0U, 0U, stepX, stepY };
+    bool paired = false;
+    uint pairX = 0U;
+    uint pairY = 0U;
+    for (uint y0 = 0; y0 < resultHeight_; y0 += stepY)
+    {
+        for (uint x0 = 0; x0 < resultWidth_; x0 += stepX)
+        {
+            // A tile of the frame size is the frame itself
+            const bool isFrame = tileWidth_ == imageWidth_ && tileHeight_ == imageHeight_;
+            if (!isFrame)
+            {
+                loadTile(image, cellStride, x0, y0);
+            }
+            if (!forward_.calcForward(isFrame ? image : tile_,
+                    isFrame ? cellStride : channelCount_))
+            {
+                return false;
+            }
+            multiplySpectra(paired);
+            if (!paired)
+            {
+                paired = true;
+                pairX = x0;
+                pairY = y0;
+                continue;
+            }
+            if (!inverse_.calcInversePruned(product_, tileWidth_, output, cropped_, stepX))
+            {
+                return false;
+            }
+            storeTile(pairX, pairY, false);
+            storeTile(x0, y0, true);
+            paired = false;
+        }
+    }
+    if (paired)
+    {
+        if (!inverse_.calcInversePruned(product_, tileWidth_, output, cropped_, stepX))
+        {
+            return false;
+        }
+        storeTile(pairX, pairY, false);
+    }
+    return true;
+}
+
+void FftCorrelationProto::storeTile(const uint x0, const uint y0, const bool imaginary)
+{
+    const uint stepX = tileWidth_ - templateWidth_ + 1U;
+    const uint width = std::min(stepX, resultWidth_ - x0);
+    const uint height = std::min(tileHeight_ - templateHeight_ + 1U, resultHeight_ - y0);
+    const float *src = cropped_ + (imaginary ? 1 : 0);
+    for (uint y = 0; y < height; ++y)
+    {
+        float *dst = dstReal_ + x0 + (y0 + y) * resultWidth_;
+        for (uint x = 0; x < width; ++x)
+        {
+            dst[x] = src[2 * (x + y * stepX)];
+        }
+    }
+}
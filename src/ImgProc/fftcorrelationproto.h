@@ -0,0 +1,95 @@
+#ifndef FFTCORRELATIONPROTO_H
+#define FFTCORRELATIONPROTO_H
+
+#include <fftproto.h>
+
+// Cross-correlation of a real multi-channel image with a template through the FFT:
+// r(x, y) = \sum_c \sum_{u, v} f_c(x + u, y + v) \cdot t_c(u, v). Images and templates are
+// cell-major like the HOG descriptor: channel c of cell (x, y) at src[(x + y * width) *
+// cellStride + c]. setTemplate transforms the template once and keeps its spectrum; calc then
+// transforms the image, sums F_c \cdot \overline{T_c} over the channels in a single pass and
+// runs one inverse, all buffers being allocated by init.
+//
+// init: circular correlation of a width x height image with a template of the same size, the
+// indices wrapping around (the tracker case).
+// initOverlapSave: valid correlation of a large frame with a small template, i.e.
+// (frameWidth - templateWidth + 1) x (frameHeight - templateHeight + 1) responses. The frame is
+// cut into overlapping tiles of a radix size, each one correlated circularly, and the
+// responses which wrapped around are dropped (overlap-save). The responses are real, so the
+// tiles go by pairs through the inverse: one as the real part, the other as the imaginary one.
+//
+// calcGaussian (circular only) maps the correlation through the Gaussian kernel of a KCF
+// tracker: k(x, z) = e^{-\max(0, \|x\|^2 + \|z\|^2 - 2 \cdot r) / (\sigma^2 \cdot N)}, N being
+// width * height * channelCount. The squared norms come from the spectra (Parseval's theorem)
+// while they are summed, so the image is read once.
+class FftCorrelationProto
+{
+public:
+    ~FftCorrelationProto();
+    bool init(
+        const uint width,
+        const uint height,
+        const uint channelCount,
+        const FftAlgorithm algorithm = FftAlgorithm::stockham);
+    // A zero tile size is picked to minimise the estimated cost of the whole frame
+    bool initOverlapSave(
+        const uint frameWidth,
+        const uint frameHeight,
+        const uint templateWidth,
+        const uint templateHeight,
+        const uint channelCount,
+        const uint tileWidth = 0U,
+        const uint tileHeight = 0U,
+        const FftAlgorithm algorithm = FftAlgorithm::stockham);
+    void release();
+    // templateWidth x templateHeight cells
+    bool setTemplate(const float *templ, const uint cellStride);
+    // width x height (or frameWidth x frameHeight) cells
+    bool calc(const float *image, const uint cellStride);
+    bool calcGaussian(const float *image, const uint cellStride, const float sigma);
+    // resultWidth() x resultHeight() responses, row by row
+    const float *result() const;
+    uint resultWidth() const { return resultWidth_; }
+    uint resultHeight() const { return resultHeight_; }
+    uint tileWidth() const { return tileWidth_; }
+    uint tileHeight() const { return tileHeight_; }
+
+protected:
+    bool initTiles(const FftAlgorithm algorithm);
+    // Copies the cells of the image at (x0, y0) into tile_, zeros beyond the image
+    void loadTile(const float *image, const uint cellStride, const uint x0, const uint y0);
+    // product_ = \sum_c F_c \cdot \overline{T_c}, or product_ += i \cdot \sum_c ... for the
+    // second tile of a pair. Returns \sum_c \sum_k |F_c(k)|^2.
+    double multiplySpectra(const bool imaginary);
+    bool calcCircular(const float *image, const uint cellStride);
+    bool calcOverlapSave(const float *image, const uint cellStride);
+    // Copies the responses of the tile at (x0, y0) out of the real or the imaginary part of
+    // cropped_
+    void storeTile(const uint x0, const uint y0, const bool imaginary);
+
+    bool overlapSave_ = false;
+    uint imageWidth_ = 0U;
+    uint imageHeight_ = 0U;
+    uint templateWidth_ = 0U;
+    uint templateHeight_ = 0U;
+    uint channelCount_ = 0U;
+    uint tileWidth_ = 0U;
+    uint tileHeight_ = 0U;
+    uint resultWidth_ = 0U;
+    uint resultHeight_ = 0U;
+    // \sum_c \|t_c\|^2
+    double templateSquaredNorm_ = 0.0;
+    Fft2dChannelsProto forward_;
+    Fft2dProto inverse_;
+    // Real cells of one tile (channelCount_ per cell)
+    float *tile_ = nullptr;
+    // channelCount_ complex values per cell
+    float *templateSpectrum_ = nullptr;
+    // One complex value per cell
+    float *product_ = nullptr;
+    // Overlap-save only: the complex responses of a tile pair which did not wrap around
+    float *cropped_ = nullptr;
+    float *dstReal_ = nullptr;
+};
+
+#endif // FFTCORRELATIONPROTO_H
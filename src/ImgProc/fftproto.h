@@ -1,50 +1,372 @@
 #ifndef FFTPROTO_H
 #define FFTPROTO_H
 
+#include <functional>
 #include <vector>
 
 using uint = unsigned int;
 
+class ThreadPool;
+class FftWisdom;
+
+// Both engines share the radix butterflies and the twiddle tables. digitReversal gathers the
+// input through a permutation and then runs the stages in place; stockham is self-sorting:
+// every stage reads one buffer and writes the other in natural order, so there is no gather.
+enum class FftAlgorithm : int
+{
+    digitReversal = 0,
+    stockham
+};
+
+// Everything that depends only on the transform size: the radix stages, the digit-reversal
+// permutation and the twiddle factors of every stage. Built once and reused by each transform.
+class FftPlan
+{
+public:
+    ~FftPlan();
+    bool init(
+        const uint N,
+        const std::vector<uint> *stages = nullptr,
+        const FftAlgorithm algorithm = FftAlgorithm::digitReversal);
+    void release();
+
+    uint N_ = 0U;
+    FftAlgorithm algorithm_ = FftAlgorithm::digitReversal;
+    std::vector<uint> stages_;
+    // Allocated for FftAlgorithm::digitReversal only
+    uint *digitReversal_ = nullptr;
+    // For each stage: Nx blocks (one per nx) of Ny - 1 complex factors
+    // e^{-2 \cdot \pi \cdot i \cdot n_x \cdot k_y / (N_x \cdot N_y)}, k_y = 1..Ny-1.
+    float *twiddles_ = nullptr;
+
+protected:
+    bool initRadixStages();
+    void initDigitReversal();
+    void initTwiddles();
+};
+
+// Sizes whose prime factors are all radices of the stages (2..7) are transformed directly.
+// Any other N goes through Bluestein's chirp-z algorithm: with w_n = e^{-\pi \cdot i \cdot n^2 / N},
+// X_k = w_k \cdot \sum_n (x_n \cdot w_n) \cdot \overline{w_{k - n}}, the convolution being done by
+// two transforms of a radix size M >= 2N - 1 (the plan is then built for M).
 class FftProto
 {
 public:
     ~FftProto();
-    bool init(const uint N, const std::vector<uint> *stages = nullptr);
+    bool init(
+        const uint N,
+        const std::vector<uint> *stages = nullptr,
+        const FftAlgorithm algorithm = FftAlgorithm::digitReversal);
     void release();
     bool calcForward(const float *srcReal);
     bool calc(const float *srcComplex, const bool inverse);
+    // Writes the N values of the transform into a caller buffer instead of result(), e.g. a
+    // slice of an arena shared by several transforms. srcComplex must not be dstComplex (for
+    // in-place transforms see FftBatchProto).
+    bool calc(const float *srcComplex, float *dstComplex, const bool inverse);
     const float* result() const;
+    bool isBluestein() const { return chirp_ != nullptr; }
 
 protected:
-    bool initRadixStages();
-    void initDigitReversal();
-    bool calcRadixStages(const bool inverse);
+    bool initBluestein(const uint N, const FftAlgorithm algorithm);
+    // Unscaled transform of plan_.N_ points into dstComplex; srcComplex must not be dstComplex
+    bool calcPlan(const float *srcComplex, float *dstComplex, const bool inverse);
+    bool calcBluestein(const float *srcComplex, float *dstComplex, const bool inverse);
+    bool calcRadixStages(float *dstComplex, const bool inverse);
+    bool calcStockham(const float *srcComplex, float *dstComplex, const bool inverse);
 
     uint N_ = 0U;
-    std::vector<uint> stages_;
-    uint *digitReversal_ = nullptr;
+    FftPlan plan_;
     float *dstComplex_ = nullptr;
+    // The second Stockham buffer
+    float *scratch_ = nullptr;
+    // Bluestein only: w_n (N values), the spectrum of the wrapped conjugate chirp scaled by 1 / M
+    // and the padded input (M values each)
+    float *chirp_ = nullptr;
+    float *chirpSpectrum_ = nullptr;
+    float *padded_ = nullptr;
 };
 
+// Whether N has no prime factors above 7, i.e. FftProto transforms it without Bluestein
+bool isRadixFftSize(uint N);
+// The smallest radix size >= N
+uint getNextRadixFftSize(uint N);
+// Mean time in microseconds of a forward FftProto transform of N points, optionally with the
+// given radix stages (see FftProto::init)
+double measureFftCost(
+    const uint N,
+    const FftAlgorithm algorithm = FftAlgorithm::stockham,
+    const int iterations = 16,
+    const std::vector<uint> *stages = nullptr);
+// Same per line of a forward FftBatchProto transform of 8 contiguous lines, the path of the
+// 2D transforms
+double measureFftBatchCost(
+    const uint N,
+    const FftAlgorithm algorithm = FftAlgorithm::stockham,
+    const int iterations = 16,
+    const std::vector<uint> *stages = nullptr);
+// The size in [N, maxN] with the smallest cost(size): N itself (transformed with Bluestein if
+// need be) or a radix size to pad to. Larger non-radix sizes are not tried: their Bluestein
+// transforms are at least as large as the one of N. E.g. cost = [](uint n) { return
+// measureFftCost(n); }.
+uint findCheapestFftSize(uint N, uint maxN, const std::function<double(uint)> &cost);
+
+// Transform of a real signal which stores only the non-redundant half of the Hermitian
+// spectrum: N / 2 + 1 complex bins. Even N are computed via a complex transform of the half
+// length over the packed pairs (x[2n], x[2n + 1]); odd N fall back to a full complex transform.
+// With wisdom, that transform uses the plan tuned for its length if there is one.
+class FftRealProto
+{
+public:
+    ~FftRealProto();
+    bool init(
+        const uint N,
+        const FftAlgorithm algorithm = FftAlgorithm::digitReversal,
+        const FftWisdom *wisdom = nullptr);
+    void release();
+    // srcReal -> N / 2 + 1 complex bins
+    bool calcForward(const float *srcReal);
+    // N / 2 + 1 complex bins -> N reals, scaled by 1 / N as FftProto::calc does
+    bool calcInverse(const float *srcSpectrum);
+    const float* result() const;
+    uint spectrumLength() const { return N_ / 2U + 1U; }
+    // Even N only, both may work in place: the spectrum Z of the packed pairs (N / 2 complex
+    // bins) <-> the N / 2 + 1 bins of the real signal. Used to batch the packed transforms.
+    bool unpackSpectrum(const float *srcPacked, float *dstSpectrum) const;
+    bool packSpectrum(const float *srcSpectrum, float *dstPacked) const;
+
+protected:
+    uint N_ = 0U;
+    FftProto fft_;
+    // e^{-2 \cdot \pi \cdot i \cdot k / N}, k = 0..N/2 (even N only)
+    float *twiddles_ = nullptr;
+    float *dstComplex_ = nullptr;
+    float *scratch_ = nullptr;
+    const float *result_ = nullptr;
+};
+
+// Transforms many lines of a complex buffer at once and in place: element n of line l is
+// data[2 * (l * lineStride + n * elemStride)], both strides in complex elements. Lines are
+// processed in lockstep in groups of 8 (AVX2, chosen at runtime) or 4 (SSE), the butterflies
+// being vectorised across lines rather than within one line. Non-radix N are transformed one
+// line at a time by a Bluestein FftProto (laneCount() is 1 then). stages are the optional
+// radix stages of FftProto::init, e.g. a tuned FftWisdom::Plan.
+class FftBatchProto
+{
+public:
+    ~FftBatchProto();
+    bool init(
+        const uint N,
+        const FftAlgorithm algorithm = FftAlgorithm::stockham,
+        const uint maxLaneCount = 8U,
+        const std::vector<uint> *stages = nullptr);
+    void release();
+    bool calc(
+        float *data,
+        const uint lineCount,
+        const uint lineStride,
+        const uint elemStride,
+        const bool inverse);
+    // Out of place with separate strides: line l is read from src + 2 * l * srcLineStride and
+    // written to dst + 2 * l * dstLineStride. src may be dst if the strides are the same.
+    bool calc(
+        const float *src,
+        const uint srcLineStride,
+        const uint srcElemStride,
+        float *dst,
+        const uint dstLineStride,
+        const uint dstElemStride,
+        const uint lineCount,
+        const bool inverse);
+    uint laneCount() const { return laneCount_; }
+
+protected:
+    bool calcBluesteinLines(
+        const float *src,
+        const uint srcLineStride,
+        const uint srcElemStride,
+        float *dst,
+        const uint dstLineStride,
+        const uint dstElemStride,
+        const uint lineCount,
+        const bool inverse);
+
+    uint N_ = 0U;
+    FftPlan plan_;
+    // Non-radix N only
+    FftProto line_;
+    uint laneCount_ = 0U;
+    // Two lane buffers of 2 * N * laneCount_ floats, 32-byte aligned (one line for line_)
+    float *work_ = nullptr;
+};
+
+// How the 2D transforms run the column pass: over the rows of a transposed copy (two
+// cache-blocked transposes per transform, folded into the row and column passes by
+// Fft2dProto) or directly over the columns in place, with the batched butterflies striding
+// through the rows.
+enum class FftColumns : int
+{
+    transposed = 0,
+    strided
+};
+
+// The 2D transforms below take an optional FftWisdom: the lines of a length it has a plan for
+// are transformed with the tuned stages and algorithm instead of algorithm.
+
+// A rectangle of a 2D transform, in elements. An aggregate for brace initialisation under
+// C++11, FftRect() is the empty one.
+struct FftRect
+{
+    uint x_;
+    uint y_;
+    uint width_;
+    uint height_;
+};
+
+// With a thread pool the row and the column passes are split into bands of lines, one per
+// pool thread, each band going through its own FftBatchProto (and thus its own lane scratch).
+// The pool is not owned, must outlive the transform and keep its thread count.
 class Fft2dProto
 {
 public:
     ~Fft2dProto();
-    bool init(const uint width, const uint height);
+    bool init(
+        const uint width,
+        const uint height,
+        const FftAlgorithm algorithm = FftAlgorithm::digitReversal,
+        const FftColumns columns = FftColumns::strided,
+        ThreadPool *threadPool = nullptr,
+        const FftWisdom *wisdom = nullptr);
     void release();
     bool calcForward(const float *srcReal);
     bool calc(const float *srcComplex, const bool inverse);
+    // Caller-owned buffers, result() is left untouched: element (x, y) is at
+    // src[2 * (y * srcRowStride + x)] and dst[2 * (y * dstRowStride + x)], e.g. a window of a
+    // larger image or a slice of an arena shared by several transforms. src may be dst (in
+    // place) if both strides are the same.
+    bool calc(
+        const float *src,
+        const uint srcRowStride,
+        float *dst,
+        const uint dstRowStride,
+        const bool inverse);
+    // Pruned transforms of zero-padded windows. The forward one transforms a signal which is
+    // zero outside valid: src holds only the valid values (element (x, y) of valid at
+    // src[2 * (y * srcRowStride + x)]), dst receives the whole spectrum. The inverse one
+    // computes only the output values inside output, which are written to dst the same way.
+    // The line transforms of zero input lines, or of lines whose output is not needed, are
+    // skipped, the pass order being picked to skip the most work. Both go through the strided
+    // columns whatever the FftColumns; the inverse uses the internal result as its work buffer.
+    bool calcForwardPruned(
+        const float *src,
+        const uint srcRowStride,
+        const FftRect &valid,
+        float *dst,
+        const uint dstRowStride);
+    bool calcInversePruned(
+        const float *src,
+        const uint srcRowStride,
+        const FftRect &output,
+        float *dst,
+        const uint dstRowStride);
+    const float *result() const;
+
+    // Smaller transforms stay on the calling thread: waking the workers would cost about as
+    // much as the transform itself
+    static const uint parallelMinSize_ = 64U * 64U;
+
+protected:
+    bool calcLines(
+        FftBatchProto *fft,
+        const float *src,
+        const uint srcLineStride,
+        const uint srcElemStride,
+        float *dst,
+        const uint dstLineStride,
+        const uint dstElemStride,
+        const uint lineCount,
+        const bool inverse);
+    bool isInside(const FftRect &rect) const;
+    // Estimated cost of transforming rowCount rows and columnCount columns
+    double getPassCost(const uint rowCount, const uint columnCount) const;
+
+    uint width_ = 0U;
+    uint height_ = 0U;
+    ThreadPool *threadPool_ = nullptr;
+    // One row and one column transform per pool thread
+    uint threadCount_ = 0U;
+    FftBatchProto *hor_ = nullptr;
+    FftBatchProto *ver_ = nullptr;
+    float *dstComplex_ = nullptr;
+    // FftColumns::transposed only
+    float *transposed_ = nullptr;
+};
+
+// 2D transforms of every channel of an interleaved cell-major image, e.g. the HOG descriptor
+// (channel c of cell (x, y) at src[(x + y * width) * cellStride + c]), in one call. The result
+// keeps the layout, with channelCount complex values per cell. The rows (or columns) of
+// neighbouring channels are neighbouring lines in memory, so the batched butterflies run across
+// the channels and no plane is ever de-interleaved.
+class Fft2dChannelsProto
+{
+public:
+    ~Fft2dChannelsProto();
+    bool init(
+        const uint width,
+        const uint height,
+        const uint channelCount,
+        const FftAlgorithm algorithm = FftAlgorithm::digitReversal,
+        const FftWisdom *wisdom = nullptr);
+    void release();
+    bool calcForward(const float *srcReal, const uint cellStride);
+    // channelCount complex values per cell
+    bool calc(const float *srcComplex, const bool inverse);
     const float *result() const;
+    uint channelCount() const { return channelCount_; }
 
 protected:
     bool calc(const bool inverse);
 
     uint width_ = 0U;
     uint height_ = 0U;
-    FftProto hor_;
-    FftProto ver_;
+    uint channelCount_ = 0U;
+    FftBatchProto hor_;
+    FftBatchProto ver_;
+    float *dstComplex_ = nullptr;
+};
+
+// 2D counterpart of FftRealProto: real width x height input, height x (width / 2 + 1)
+// complex spectrum.
+class Fft2dRealProto
+{
+public:
+    ~Fft2dRealProto();
+    bool init(
+        const uint width,
+        const uint height,
+        const FftAlgorithm algorithm = FftAlgorithm::digitReversal,
+        const FftColumns columns = FftColumns::strided,
+        const FftWisdom *wisdom = nullptr);
+    void release();
+    bool calcForward(const float *srcReal);
+    bool calcInverse(const float *srcSpectrum);
+    const float* result() const;
+    uint spectrumWidth() const { return width_ / 2U + 1U; }
+
+protected:
+    bool calcColumns(const bool inverse);
+
+    uint width_ = 0U;
+    uint height_ = 0U;
+    FftRealProto hor_;
+    // Even width: the rows of packed pairs are transformed by one batched call
+    FftBatchProto horPacked_;
+    FftBatchProto ver_;
     float *dstComplex_ = nullptr;
+    float *dstReal_ = nullptr;
+    // FftColumns::transposed only
     float *transposed_ = nullptr;
+    const float *result_ = nullptr;
 };
 
 #endif // FFTPROTO_H
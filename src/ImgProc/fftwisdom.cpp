@@ -0,0 +1,203 @@
+#include <fftwisdom.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+static const char *getAlgorithmName(const FftAlgorithm algorithm)
+{
+    return algorithm == FftAlgorithm::stockham ? "stockham" : "digitReversal";
+}
+
+static bool parseAlgorithmName(const std::string &name, FftAlgorithm &algorithm)
+{
+    for (const FftAlgorithm a : {FftAlgorithm::digitReversal, FftAlgorithm::stockham})
+    {
+        if (name == getAlgorithmName(a))
+        {
+            algorithm = a;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Appends to candidates every non-increasing sequence of radices <= maxNy with the product N
+static void addStageCandidates(
+    const uint N,
+    const uint maxNy,
+    std::vector<uint> &stages,
+    std::vector<std::vector<uint>> &candidates)
+{
+    if (N == 1U)
+    {
+        candidates.push_back(stages);
+        return;
+    }
+    for (uint Ny = std::min(maxNy, 8U); Ny >= 2U; --Ny)
+    {
+        if (N % Ny == 0U)
+        {
+            stages.push_back(Ny);
+            addStageCandidates(N / Ny, Ny, stages, candidates);
+            stages.pop_back();
+        }
+    }
+}
+
+const FftWisdom::Plan *FftWisdom::tune(const uint N, const int iterations)
+{
+    const Plan *known = find(N);
+    if (known)
+    {
+        return known;
+    }
+    std::vector<std::vector<uint>> candidates = getStageCandidates(N);
+    if (candidates.empty())
+    {
+        // Bluestein: the stages of the padded size are not configurable
+        candidates.emplace_back();
+    }
+
+    // Every candidate is timed in a few interleaved rounds and keeps its best time, which
+    // makes the choice less sensitive to what else the machine is doing
+    const int roundCount = 3;
+    const FftAlgorithm algorithms[] = {FftAlgorithm::digitReversal, FftAlgorithm::stockham};
+    std::vector<double> costs(2 * candidates.size(), -1.0);
+    for (int round = 0; round < roundCount; ++round)
+    {
+        for (size_t i = 0; i < costs.size(); ++i)
+        {
+            const std::vector<uint> &stages = candidates[i / 2];
+            const double cost = measureFftBatchCost(
+                N, algorithms[i % 2], iterations, stages.empty() ? nullptr : &stages);
+            if (cost >= 0.0 && (costs[i] < 0.0 || cost < costs[i]))
+            {
+                costs[i] = cost;
+            }
+        }
+    }
+
+    Plan best;
+    best.cost_ = -1.0;
+    for (size_t i = 0; i < costs.size(); ++i)
+    {
+        if (costs[i] >= 0.0 && (best.cost_ < 0.0 || costs[i] < best.cost_))
+        {
+            best.stages_ = candidates[i / 2];
+            best.algorithm_ = algorithms[i % 2];
+            best.cost_ = costs[i];
+        }
+    }
+    if (best.cost_ < 0.0)
+    {
+        return nullptr;
+    }
+    return &(plans_[N] = best);
+}
+
+const FftWisdom::Plan *FftWisdom::find(const uint N) const
+{
+    const auto it = plans_.find(N);
+    return it == plans_.end() ? nullptr : &it->second;
+}
+
+void FftWisdom::clear()
+{
+    plans_.clear();
+}
+
+bool FftWisdom::save(const std::string &path) const
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+    file << "# N algorithm cost[us] stages...\n";
+    for (const auto &entry : plans_)
+    {
+        const Plan &plan = entry.second;
+        file << entry.first << ' ' << getAlgorithmName(plan.algorithm_) << ' ' << plan.cost_;
+        for (const uint Ny : plan.stages_)
+        {
+            file << ' ' << Ny;
+        }
+        file << '\n';
+    }
+    return static_cast<bool>(file);
+}
+
+bool FftWisdom::load(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+    std::map<uint, Plan> plans;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream fields(line);
+        uint N = 0U;
+        std::string algorithmName;
+        Plan plan;
+        if (!(fields >> N >> algorithmName >> plan.cost_) ||
+            !parseAlgorithmName(algorithmName, plan.algorithm_))
+        {
+            return false;
+        }
+        uint stagesProduct = 1U;
+        uint Ny = 0U;
+        while (fields >> Ny)
+        {
+            if (Ny < 2U || Ny > 8U)
+            {
+                return false;
+            }
+            plan.stages_.push_back(Ny);
+            stagesProduct *= Ny;
+        }
+        // Anything left on the line is not a radix
+        if (!fields.eof())
+        {
+            return false;
+        }
+        const bool bluestein = plan.stages_.empty() && N > 0U && !isRadixFftSize(N);
+        if (stagesProduct != N && !bluestein)
+        {
+            return false;
+        }
+        plans[N] = plan;
+    }
+    for (const auto &entry : plans)
+    {
+        plans_[entry.first] = entry.second;
+    }
+    return true;
+}
+
+std::vector<std::vector<uint>> FftWisdom::getStageCandidates(const uint N)
+{
+    std::vector<std::vector<uint>> candidates;
+    if (!isRadixFftSize(N))
+    {
+        return candidates;
+    }
+    std::vector<uint> stages;
+    addStageCandidates(N, 8U, stages, candidates);
+    const size_t descendingCount = candidates.size();
+    for (size_t i = 0; i < descendingCount; ++i)
+    {
+        std::vector<uint> ascending(candidates[i].rbegin(), candidates[i].rend());
+        if (ascending != candidates[i])
+        {
+            candidates.push_back(ascending);
+        }
+    }
+    return candidates;
+}
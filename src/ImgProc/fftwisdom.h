@@ -0,0 +1,55 @@
+#ifndef FFTWISDOM_H
+#define FFTWISDOM_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <fftproto.h>
+
+// The fastest radix stage order and algorithm per transform size, measured on this machine.
+// FftPlan otherwise factors N greedily (largest radix first), which is not always the fastest
+// order. The candidates are timed through FftBatchProto, the lane-batched path of the 2D
+// transforms, which take the wisdom as it is. Tuned plans are kept in memory and can be saved
+// to / loaded from a text file with one "N algorithm cost stages..." line per size, so that a
+// process can start from the plans measured by an earlier one, e.g.
+//     if (!wisdom.load(path)) { wisdom.tune(width); wisdom.tune(height); wisdom.save(path); }
+//     fft2d.init(width, height, algorithm, FftColumns::strided, nullptr, &wisdom);
+// A single transform takes the plan itself:
+//     const FftWisdom::Plan *plan = wisdom.find(N);
+//     fft.init(N, plan->stagesOrNull(), plan->algorithm_);
+class FftWisdom
+{
+public:
+    struct Plan
+    {
+        // Empty for sizes that go through Bluestein, where only the algorithm is tuned
+        std::vector<uint> stages_;
+        FftAlgorithm algorithm_ = FftAlgorithm::digitReversal;
+        // Mean forward transform time of a line in microseconds when it was tuned (see
+        // measureFftBatchCost)
+        double cost_ = 0.0;
+
+        const std::vector<uint> *stagesOrNull() const { return stages_.empty() ? nullptr : &stages_; }
+    };
+
+    // Times every candidate of N with both algorithms unless N is already tuned.
+    // Returns nullptr if no candidate could be initialized.
+    const Plan *tune(const uint N, const int iterations = 32);
+    // nullptr if N has not been tuned or loaded
+    const Plan *find(const uint N) const;
+    void clear();
+    bool save(const std::string &path) const;
+    // Adds the plans of the file to the ones in memory (the file wins for sizes in both).
+    // Returns false, keeping the plans in memory, if the file can't be read or a line is
+    // not a valid plan.
+    bool load(const std::string &path);
+
+    // Every distinct multiset of radices 2..8 whose product is N, each both in descending and
+    // in ascending order. Empty if N is not a radix size.
+    static std::vector<std::vector<uint>> getStageCandidates(const uint N);
+
+protected:
+    std::map<uint, Plan> plans_;
+};
+
+#endif // FFTWISDOM_H
@@ -1,11 +1,46 @@
+// The defaults of HogSettings, overridden by the -D options of HogProgramCache
+#ifndef SENS_BINS
 #define SENS_BINS 18
+#endif
+#define INS_BINS (SENS_BINS / 2)
 #define BINS_PER_BLOCK (SENS_BINS * 3 / 2 + 4)
 
+#define BIN_LUT_SZ 32
+
+#ifndef HALF_CELL_SZ
 #define HALF_CELL_SZ 2
+#endif
 #define CELL_SZ (HALF_CELL_SZ * 2)
+#ifndef TRUNC
 #define TRUNC 0.2f
-
+#endif
+
+// The element type of the block descriptors (HogDescriptorFormat): float, half, or uchar
+// scaled by 255 / DESC_MAX, the largest value of a channel (2 * TRUNC for the bins, up to
+// INS_BINS * TRUNC * 0.2357f for the texture ones)
+#define DESC_FLOAT 0
+#define DESC_HALF 1
+#define DESC_UCHAR 2
+#ifndef DESC_FORMAT
+#define DESC_FORMAT DESC_FLOAT
+#endif
+#if DESC_FORMAT == DESC_HALF
+typedef half desc_t;
+#elif DESC_FORMAT == DESC_UCHAR
+typedef uchar desc_t;
+#else
+typedef float desc_t;
+#endif
+#define DESC_MAX (2.0f * TRUNC > 0.2357f * INS_BINS * TRUNC ? 2.0f * TRUNC : \
+    0.2357f * INS_BINS * TRUNC)
+
+// Fixed point of the local histograms: 1e6 for 4x4 cells, less for the larger ones so that
+// their sums stay in the uint range
+#define HIST_SCALE (1.6e7f / (CELL_SZ * CELL_SZ))
+
+#ifndef HOG_WG_SZ_BIG
 #define HOG_WG_SZ_BIG 16
+#endif
 #define HOG_WG_SZ_BIG_LIN (HOG_WG_SZ_BIG * HOG_WG_SZ_BIG)
 
 #define CELL_CNT_LOC (HOG_WG_SZ_BIG / CELL_SZ)
@@ -25,16 +60,64 @@
 #define HOG_WG_SZ_SMALL_PAD_LIN (HOG_WG_SZ_SMALL_PAD * HOG_WG_SZ_SMALL_PAD)
 #define HOG_CELL_NORMS_SUM_X_SZ_LIN (HOG_WG_SZ_SMALL * HOG_WG_SZ_SMALL_PAD)
 
+#define HOG_WG_SZ_SMALL_HALO (HOG_WG_SZ_SMALL + 2)
+#define HOG_WG_SZ_SMALL_HALO_LIN (HOG_WG_SZ_SMALL_HALO * HOG_WG_SZ_SMALL_HALO)
+
+// Values per work-item to fill the local arrays, 2 each with the defaults
+#define IM_LOADS_PER_WI ((HOG_IM_LOC_SZ_LIN + HOG_WG_SZ_BIG_LIN - 1) / HOG_WG_SZ_BIG_LIN)
+#define DERIVS_PER_WI ((HOG_DERIVS_LOC_SZ_LIN + HOG_WG_SZ_BIG_LIN - 1) / HOG_WG_SZ_BIG_LIN)
+#define BINS_PER_WI ((BINS_CNT_LOC + HOG_WG_SZ_BIG_LIN - 1) / HOG_WG_SZ_BIG_LIN)
+#define NORMS_LOADS_PER_WI \
+    ((HOG_WG_SZ_SMALL_PAD_LIN + HOG_WG_SZ_SMALL_LIN - 1) / HOG_WG_SZ_SMALL_LIN)
+
+// Per scale of a pyramid: the offset of its image, its width and height in pixels, the offset
+// of its first cell and of its padded cell norms
+#define SCALE_IM_OFFSET 0
+#define SCALE_WIDTH 1
+#define SCALE_HEIGHT 2
+#define SCALE_CELL_OFFSET 3
+#define SCALE_NORMS_OFFSET 4
+#define SCALE_LAYOUT_SZ 5
+
+// atan(i / BIN_LUT_SZ) in turns, the values of HogProto::calculateBinLut over its bin count
+__constant float binLut[BIN_LUT_SZ + 1] = {
+    0.0f, 0.00497197406f, 0.00993426237f, 0.0148772914f, 0.019791713f, 0.024668498f,
+    0.0294990428f, 0.0342752412f, 0.0389895663f, 0.0436351039f, 0.0482056253f, 0.0526955761f,
+    0.0571001247f, 0.0614151359f, 0.0656371638f, 0.0697634295f, 0.0737918094f, 0.0777207613f,
+    0.0815493166f, 0.085277006f, 0.0889038444f, 0.0924302414f, 0.0958570093f, 0.0991852507f,
+    0.102416381f, 0.105552033f, 0.108594052f, 0.111544445f, 0.114405349f, 0.117179006f,
+    0.11986775f, 0.12247394f, 0.125f };
+
+inline float calcBinExact(const float2 grad)
+{
+    const float ang = atan2pi(grad.y, grad.x) * 0.5f;
+    return SENS_BINS * (ang + (float)(ang < 0.0f));
+}
+
+// The bin within the first octant interpolated from binLut, then folded back from the signs
+// and the larger component
+inline float lookUpBin(const float2 grad)
+{
+    const float2 absGrad = fabs(grad);
+    const float maxXY = fmax(absGrad.x, absGrad.y);
+    const float t = maxXY > 0.0f ? fmin(absGrad.x, absGrad.y) / maxXY * BIN_LUT_SZ : 0.0f;
+    const int i = min((int)t, BIN_LUT_SZ - 1);
+    float bin = SENS_BINS * mad(t - (float)i, binLut[i + 1] - binLut[i], binLut[i]);
+    bin = absGrad.x < absGrad.y ? SENS_BINS * 0.25f - bin : bin;
+    bin = grad.x < 0.0f ? SENS_BINS * 0.5f - bin : bin;
+    return grad.y < 0.0f ? SENS_BINS - bin : bin;
+}
+
 inline void calcDerivsInl(
     __local const float* const restrict im,
     __local float* const restrict derivsX,
     __local float* const restrict derivsY,
-    const int imId[2],
-    const int derivId[2],
-    const int isValid[2])
+    const int imId[DERIVS_PER_WI],
+    const int derivId[DERIVS_PER_WI],
+    const int isValid[DERIVS_PER_WI])
 {
-    #pragma unroll 2
-    for (int i = 0; i < 2; ++i)
+    #pragma unroll
+    for (int i = 0; i < DERIVS_PER_WI; ++i)
     {
         derivsX[derivId[i]] = !isValid[i] ? 0.0f : (im[imId[i] + 1] - im[imId[i] - 1]);
         derivsY[derivId[i]] = !isValid[i] ? 0.0f :
@@ -42,20 +125,61 @@ inline void calcDerivsInl(
     }
 }
 
+inline void foldCellDesc(
+    const float sensDesc[SENS_BINS],
+    float insDesc[INS_BINS])
+{
+    #pragma unroll
+    for (int i = 0; i < INS_BINS; ++i)
+    {
+        insDesc[i] = sensDesc[i] + sensDesc[i + INS_BINS];
+    }
+}
+
+inline float calcCellNorm(const float insDesc[INS_BINS])
+{
+    float norm = 0.0f;
+    #pragma unroll
+    for (int i = 0; i < INS_BINS; ++i)
+    {
+        norm = mad(insDesc[i], insDesc[i], norm);
+    }
+    return norm;
+}
+
+// Squared norm of the insensitive bins of one cell from the local histograms
+inline float calcCellNormLoc(__local const uint* const restrict cellDescLoc)
+{
+    float sensDesc[SENS_BINS];
+    float insDesc[INS_BINS];
+    #pragma unroll
+    for (int i = 0; i < SENS_BINS; ++i)
+    {
+        sensDesc[i] = (float)cellDescLoc[i];
+    }
+    foldCellDesc(sensDesc, insDesc);
+    return calcCellNorm(insDesc);
+}
+
 inline void calcCellDescInl(
     __local const float* const restrict derivsX,
     __local const float* const restrict derivsY,
     __local uint* const restrict cellDescLoc,
     __global uint* const restrict cellDescGlob,
-    const int derivIdsCell[2],
+    const int derivIdsCell[4],
     const float interpCellWeights[4],
-    const int dstIdLoc[2],
+    const int dstIdLoc[BINS_PER_WI],
     const int interpCellId,
     const int binsPerIter,
-    int dstIdGlob[2])
+    const int fastBinning,
+    __global float* const restrict cellNormsGlob,
+    const int normIdLoc,
+    const int normsPerIter,
+    int dstIdGlob[BINS_PER_WI],
+    int* const normIdGlob)
 {
-    #pragma unroll 2
-    for (int i = 0; i < 2; ++i)
+    #pragma unroll
+    for (int i = 0; i < BINS_PER_WI; ++i)
     {
         cellDescLoc[dstIdLoc[i]] = 0;
     }
@@ -66,8 +190,7 @@ inline void calcCellDescInl(
     {
         const float2 grad = (float2)(derivsX[derivIdsCell[i]], derivsY[derivIdsCell[i]]);
         const float mag = fast_length(grad) * interpCellWeights[i];
-        const float ang = atan2pi(grad.y, grad.x) * 0.5f;
-        const float bin = SENS_BINS * (ang + (float)(ang < 0.0f));
+        const float bin = fastBinning ? lookUpBin(grad) : calcBinExact(grad);
 
         int2 interpBins = (int)bin;
         interpBins.s1++;
@@ -80,47 +203,61 @@ inline void calcCellDescInl(
     }
     barrier(CLK_LOCAL_MEM_FENCE);
 
-    #pragma unroll 2
-    for (int i = 0; i < 2; ++i)
+    #pragma unroll
+    for (int i = 0; i < BINS_PER_WI; ++i)
     {
         cellDescGlob[dstIdGlob[i]] = cellDescLoc[dstIdLoc[i]];
         dstIdGlob[i] += binsPerIter;
     }
+    if (cellNormsGlob && normIdLoc < CELL_CNT_LOC_LIN)
+    {
+        cellNormsGlob[*normIdGlob] = calcCellNormLoc(cellDescLoc + mul24(normIdLoc, SENS_BINS));
+        *normIdGlob += normsPerIter;
+    }
 }
 
-__kernel void calcCellDesc(
+// The imWidth x iterCnt * HOG_WG_SZ_BIG image of imStride wide rows at imGlob, its border pixels
+// replicated
+inline void calcCellDescBody(
     __global const float* const restrict imGlob,
     __global uint* const restrict cellDescGlob,
+    __global float* const restrict cellNormsGlob,
+    __local float* const restrict imLoc,
+    __local float* const restrict derivsX,
+    __local float* const restrict derivsY,
+    __local uint* const restrict cellDescLoc,
+    const int fastBinning,
+    const int imStride,
+    const int imWidth,
     const int iterCnt)
 {
-    __local float imLoc[HOG_IM_LOC_SZ_LIN];
-    __local float derivsX[HOG_DERIVS_LOC_SZ_LIN];
-    __local float derivsY[HOG_DERIVS_LOC_SZ_LIN];
-    __local uint cellDescLoc[BINS_CNT_LOC];
     const int2 wiId = (int2)(get_local_id(0), get_local_id(1));
-    const int2 imGlobSz = (int2)((int)get_global_size(0), mul24(iterCnt, (int)HOG_WG_SZ_BIG));
+    const int2 imGlobSz = (int2)(imWidth, mul24(iterCnt, (int)HOG_WG_SZ_BIG));
     const int wiIdLin = mad24(wiId.y, HOG_WG_SZ_BIG, wiId.x);
-    const int imGlobIterStep = mul24((int)HOG_WG_SZ_BIG, imGlobSz.x);
+    const int imGlobIterStep = mul24((int)HOG_WG_SZ_BIG, imStride);
     const int shiftGlobIm = mul24((int)get_group_id(0), (int)HOG_WG_SZ_BIG);
 
-    int srcIdLoc[2];
-    int srcIdGlob[2];
-    #pragma unroll 2
-    for (int i = 0; i < 2; ++i)
+    int srcIdLoc[IM_LOADS_PER_WI];
+    int srcIdGlob[IM_LOADS_PER_WI];
+    #pragma unroll
+    for (int i = 0; i < IM_LOADS_PER_WI; ++i)
     {
         srcIdLoc[i] = mad24(i, HOG_WG_SZ_BIG_LIN, wiIdLin);
         srcIdLoc[i] = srcIdLoc[i] >= HOG_IM_LOC_SZ_LIN ? srcIdLoc[0] : srcIdLoc[i];
         const int2 glob = (int2)(
             srcIdLoc[i] % HOG_IM_LOC_SZ + shiftGlobIm, srcIdLoc[i] / HOG_IM_LOC_SZ) -
             HALF_CELL_SZ - 1;
-        srcIdGlob[i] = mad24(glob.y, imGlobSz.x, clamp(glob.x, 0, imGlobSz.x - 1));
+        const int globX = clamp(glob.x, 0, imGlobSz.x - 1);
+        // The first rows, above the image, replicate row 0
+        imLoc[srcIdLoc[i]] = imGlob[mad24(max(glob.y, 0), imStride, globX)];
+        srcIdGlob[i] = mad24(glob.y, imStride, globX) + imGlobIterStep;
     }
 
-    int derivId[2];
-    int imLocIdForDeriv[2];
-    int isValidDeriv[2];
-    #pragma unroll 2
-    for (int i = 0; i < 2; ++i)
+    int derivId[DERIVS_PER_WI];
+    int imLocIdForDeriv[DERIVS_PER_WI];
+    int isValidDeriv[DERIVS_PER_WI];
+    #pragma unroll
+    for (int i = 0; i < DERIVS_PER_WI; ++i)
     {
         derivId[i] = mad24(i, HOG_WG_SZ_BIG_LIN, wiIdLin);
         derivId[i] = derivId[i] >= HOG_DERIVS_LOC_SZ_LIN ? derivId[0] : derivId[i];
@@ -143,21 +280,21 @@ __kernel void calcCellDesc(
             derivIdsCell[i] = mad24(wiId.y + adjacent.y, HOG_DERIVS_LOC_SZ, wiId.x + adjacent.x);
             const float2 dist = fabs(convert_float2(neighbId - adjacent) - 0.5f);
             const float2 weight = 1.0f - half_divide(dist, CELL_SZ);
-            interpCellWeights[i] = weight.x * weight.y * 1e6f;
+            interpCellWeights[i] = weight.x * weight.y * HIST_SCALE;
         }
     }
 
     const int cellCntGlobX = imGlobSz.x / CELL_SZ;
     const int binsPerIter = mul24((int)(CELL_CNT_LOC * SENS_BINS), cellCntGlobX);
-    int dstIdLoc[2];
-    int dstIdGlob[2];
+    int dstIdLoc[BINS_PER_WI];
+    int dstIdGlob[BINS_PER_WI];
     {
         const int shiftGlobCell = mul24((int)get_group_id(0), (int)CELL_CNT_LOC);
-        #pragma unroll 2
-        for (int i = 0; i < 2; ++i)
+        #pragma unroll
+        for (int i = 0; i < BINS_PER_WI; ++i)
         {
-            dstIdLoc[i] = mad24(i, HOG_WG_SZ_BIG_LIN, wiIdLin);
-            dstIdLoc[i] = dstIdLoc[i] >= BINS_CNT_LOC ? dstIdLoc[0] : dstIdLoc[i];
+            // Large cells have fewer bins than work-items, the extra ones repeat the last bin
+            dstIdLoc[i] = min(mad24(i, HOG_WG_SZ_BIG_LIN, wiIdLin), BINS_CNT_LOC - 1);
             const int cellIdLocLin = dstIdLoc[i] / SENS_BINS;
             const int2 cellIdGlob = (int2)(
                 cellIdLocLin % CELL_CNT_LOC + shiftGlobCell, cellIdLocLin / CELL_CNT_LOC);
@@ -166,18 +303,17 @@ __kernel void calcCellDesc(
         }
     }
 
-    #pragma unroll 2
-    for (int i = 0; i < 2; ++i)
-    {
-        imLoc[srcIdLoc[i]] = imGlob[srcIdGlob[i] -
-            (srcIdGlob[i] < 0 ? mul24(srcIdGlob[i] / imGlobSz.x - 1, imGlobSz.x) : 0)];
-        srcIdGlob[i] += imGlobIterStep;
-    }
+    // The fused path also stores the cell norms, padded by one zero cell on each side like
+    // the ones of calcCellNorms
+    const int normsPerIter = mul24((int)CELL_CNT_LOC, cellCntGlobX + 2);
+    int normIdGlob = mad24(wiIdLin / CELL_CNT_LOC + 1, cellCntGlobX + 2,
+        mad24((int)get_group_id(0), (int)CELL_CNT_LOC, wiIdLin % CELL_CNT_LOC + 1));
+
     barrier(CLK_LOCAL_MEM_FENCE);
     {
-        int isValidDerivTop[2];
-        #pragma unroll 2
-        for (int i = 0; i < 2; ++i)
+        int isValidDerivTop[DERIVS_PER_WI];
+        #pragma unroll
+        for (int i = 0; i < DERIVS_PER_WI; ++i)
         {
             isValidDerivTop[i] = isValidDeriv[i] &
                 (derivId[i] / HOG_DERIVS_LOC_SZ >= HALF_CELL_SZ);
@@ -185,12 +321,13 @@ __kernel void calcCellDesc(
         calcDerivsInl(imLoc, derivsX, derivsY, imLocIdForDeriv, derivId, isValidDerivTop);
     }
     calcCellDescInl(derivsX, derivsY, cellDescLoc, cellDescGlob, derivIdsCell,
-        interpCellWeights, dstIdLoc, interpCellId, binsPerIter, dstIdGlob);
+        interpCellWeights, dstIdLoc, interpCellId, binsPerIter, fastBinning, cellNormsGlob,
+        wiIdLin, normsPerIter, dstIdGlob, &normIdGlob);
 
     for (int iter = 1; iter + 1 < iterCnt; ++iter)
     {
-        #pragma unroll 2
-        for (int i = 0; i < 2; ++i)
+        #pragma unroll
+        for (int i = 0; i < IM_LOADS_PER_WI; ++i)
         {
             imLoc[srcIdLoc[i]] = imGlob[srcIdGlob[i]];
             srcIdGlob[i] += imGlobIterStep;
@@ -198,38 +335,83 @@ __kernel void calcCellDesc(
         barrier(CLK_LOCAL_MEM_FENCE);
         calcDerivsInl(imLoc, derivsX, derivsY, imLocIdForDeriv, derivId, isValidDeriv);
         calcCellDescInl(derivsX, derivsY, cellDescLoc, cellDescGlob, derivIdsCell,
-            interpCellWeights, dstIdLoc, interpCellId, binsPerIter, dstIdGlob);
+            interpCellWeights, dstIdLoc, interpCellId, binsPerIter, fastBinning, cellNormsGlob,
+            wiIdLin, normsPerIter, dstIdGlob, &normIdGlob);
     }
 
-    imLoc[srcIdLoc[0]] = imGlob[srcIdGlob[0]];
-    imLoc[srcIdLoc[1]] = imGlob[srcIdGlob[1] - (srcIdGlob[1] >= mul24(imGlobSz.x, imGlobSz.y) ?
-        mul24(srcIdGlob[1] / imGlobSz.x - imGlobSz.y + 1, imGlobSz.x) : 0)];
+    #pragma unroll
+    for (int i = 0; i < IM_LOADS_PER_WI; ++i)
+    {
+        imLoc[srcIdLoc[i]] = imGlob[srcIdGlob[i] - (srcIdGlob[i] >= mul24(imStride, imGlobSz.y) ?
+            mul24(srcIdGlob[i] / imStride - imGlobSz.y + 1, imStride) : 0)];
+    }
     barrier(CLK_LOCAL_MEM_FENCE);
-    isValidDeriv[1] &= derivId[1] / HOG_DERIVS_LOC_SZ < HOG_WG_SZ_BIG + HALF_CELL_SZ;
+    #pragma unroll
+    for (int i = 0; i < DERIVS_PER_WI; ++i)
+    {
+        isValidDeriv[i] &= derivId[i] / HOG_DERIVS_LOC_SZ < HOG_WG_SZ_BIG + HALF_CELL_SZ;
+    }
     calcDerivsInl(imLoc, derivsX, derivsY, imLocIdForDeriv, derivId, isValidDeriv);
     calcCellDescInl(derivsX, derivsY, cellDescLoc, cellDescGlob, derivIdsCell,
-        interpCellWeights, dstIdLoc, interpCellId, binsPerIter, dstIdGlob);
+        interpCellWeights, dstIdLoc, interpCellId, binsPerIter, fastBinning, cellNormsGlob,
+        wiIdLin, normsPerIter, dstIdGlob, &normIdGlob);
 }
 
-inline void loadCellDesc(
-    __global const uint* const restrict cellDescGlob,
-    float4 sensDesc[5],
-    float4 insDesc[3])
+__kernel void calcCellDesc(
+    __global const float* const restrict imGlob,
+    __global uint* const restrict cellDescGlob,
+    __global float* const restrict cellNormsGlob,
+    const int fastBinning,
+    const int imStride,
+    const int iterCnt,
+    const int2 roiOffset)
 {
-    #pragma unroll 4
-    for (int i = 0; i < 4; ++i)
+    __local float imLoc[HOG_IM_LOC_SZ_LIN];
+    __local float derivsX[HOG_DERIVS_LOC_SZ_LIN];
+    __local float derivsY[HOG_DERIVS_LOC_SZ_LIN];
+    __local uint cellDescLoc[BINS_CNT_LOC];
+    // The region at roiOffset is processed as the whole image
+    calcCellDescBody(imGlob + mad24(roiOffset.y, imStride, roiOffset.x), cellDescGlob,
+        cellNormsGlob, imLoc, derivsX, derivsY, cellDescLoc, fastBinning, imStride,
+        get_global_size(0), iterCnt);
+}
+
+// Every scale of a pyramid in one launch, the scale being the third NDRange dimension; the
+// first one covers the widest scale
+__kernel void calcCellDescPyramid(
+    __global const float* const restrict imGlob,
+    __global uint* const restrict cellDescGlob,
+    __global float* const restrict cellNormsGlob,
+    __global const int* restrict scaleLayout,
+    const int fastBinning)
+{
+    __local float imLoc[HOG_IM_LOC_SZ_LIN];
+    __local float derivsX[HOG_DERIVS_LOC_SZ_LIN];
+    __local float derivsY[HOG_DERIVS_LOC_SZ_LIN];
+    __local uint cellDescLoc[BINS_CNT_LOC];
+    scaleLayout += mul24((int)get_global_id(2), (int)SCALE_LAYOUT_SZ);
+    const int2 imSz = vload2(0, scaleLayout + SCALE_WIDTH);
+    if (mul24((int)get_group_id(0), (int)HOG_WG_SZ_BIG) >= imSz.x)
     {
-        sensDesc[i] = convert_float4(vload4(i, cellDescGlob));
+        return;
     }
-    sensDesc[4].s01 = convert_float2(vload2(8, cellDescGlob));
-    #pragma unroll 2
-    for (int i = 0; i < 2; ++i)
+    calcCellDescBody(imGlob + scaleLayout[SCALE_IM_OFFSET],
+        cellDescGlob + mul24(scaleLayout[SCALE_CELL_OFFSET], (int)SENS_BINS),
+        cellNormsGlob + scaleLayout[SCALE_NORMS_OFFSET], imLoc, derivsX, derivsY, cellDescLoc,
+        fastBinning, imSz.x, imSz.x, imSz.y / HOG_WG_SZ_BIG);
+}
+
+inline void loadCellDesc(
+    __global const uint* const restrict cellDescGlob,
+    float sensDesc[SENS_BINS],
+    float insDesc[INS_BINS])
+{
+    #pragma unroll
+    for (int i = 0; i < SENS_BINS; ++i)
     {
-        insDesc[i] = sensDesc[i];
-        insDesc[i].s012 += sensDesc[i + 2].s123;
-        insDesc[i].s3 += sensDesc[i + 3].s0;
+        sensDesc[i] = (float)cellDescGlob[i];
     }
-    insDesc[2].s0 = sensDesc[2].s0 + sensDesc[4].s1;
+    foldCellDesc(sensDesc, insDesc);
 }
 
 __kernel void calcCellNorms(
@@ -247,15 +429,14 @@ __kernel void calcCellNorms(
     cellDescGlob += mul24((int)SENS_BINS, mad24(wiIdY, cellCntX, wiIdXglob));
     cellNormsGlob += mad24(wiIdY + 1, normCntX, wiIdXglob + 1);
 
-    float4 sensDesc[5];
-    float4 insDesc[3];
+    float sensDesc[SENS_BINS];
+    float insDesc[INS_BINS];
 
     for (int iter = 0, shiftDesc = 0, shiftNorms = 0; iter < iterCnt;
          ++iter, shiftDesc += binCntPerIter, shiftNorms += normCntPerIter)
     {
         loadCellDesc(cellDescGlob + shiftDesc, sensDesc, insDesc);
-        cellNormsGlob[shiftNorms] = insDesc[2].s0 * insDesc[2].s0 +
-            dot(insDesc[0], insDesc[0]) + dot(insDesc[1], insDesc[1]);
+        cellNormsGlob[shiftNorms] = calcCellNorm(insDesc);
     }
 }
 
@@ -271,12 +452,12 @@ __kernel void calcInvBlockNorms(
     const int wiIdLin = mad24(wiId.y, HOG_WG_SZ_SMALL, wiId.x);
     const int cellsPerIter = mul24((int)HOG_WG_SZ_SMALL, cellCntGlobX);
 
-    int srcIdLoc[2];
-    int srcIdGlob[2];
+    int srcIdLoc[NORMS_LOADS_PER_WI];
+    int srcIdGlob[NORMS_LOADS_PER_WI];
     {
         const int shiftGlob = mul24((int)get_group_id(0), (int)HOG_WG_SZ_SMALL);
-        #pragma unroll 2
-        for (int i = 0; i < 2; ++i)
+        #pragma unroll
+        for (int i = 0; i < NORMS_LOADS_PER_WI; ++i)
         {
             srcIdLoc[i] = mad24(i, HOG_WG_SZ_SMALL_LIN, wiIdLin);
             srcIdLoc[i] = srcIdLoc[i] >= HOG_WG_SZ_SMALL_PAD_LIN ? srcIdLoc[0] : srcIdLoc[i];
@@ -300,8 +481,8 @@ __kernel void calcInvBlockNorms(
 
     for (int iter = 0; iter < iterCnt; ++iter, invBlockNorms += cellsPerIter)
     {
-        #pragma unroll 2
-        for (int i = 0; i < 2; ++i)
+        #pragma unroll
+        for (int i = 0; i < NORMS_LOADS_PER_WI; ++i)
         {
             cellNormsLoc[srcIdLoc[i]] = cellNormsGlob[srcIdGlob[i]];
             srcIdGlob[i] += cellsPerIter;
@@ -317,10 +498,81 @@ __kernel void calcInvBlockNorms(
     }
 }
 
+inline void storeDesc(const float value, const int id, __global desc_t* const restrict descGlob)
+{
+#if DESC_FORMAT == DESC_HALF
+    vstore_half(value, id, descGlob);
+#elif DESC_FORMAT == DESC_UCHAR
+    descGlob[id] = convert_uchar_sat_rte(value * (255.0f / DESC_MAX));
+#else
+    descGlob[id] = value;
+#endif
+}
+
+// Normalizes one cell by the inverse norms of its 4 blocks, normsLoc[normIds[i]]
+inline void normalizeCellInl(
+    __global const uint* const restrict cellDescGlob,
+    __local const float* const restrict normsLoc,
+    const int normIds[4],
+    __global desc_t* const restrict blockDescGlob)
+{
+    float sensDesc[SENS_BINS];
+    float sensDescNorm[SENS_BINS];
+    float insDesc[INS_BINS];
+    float insDescNorm[INS_BINS];
+    float descNorm[4];
+
+    loadCellDesc(cellDescGlob, sensDesc, insDesc);
+    #pragma unroll
+    for (int i = 0; i < SENS_BINS; ++i)
+    {
+        sensDescNorm[i] = 0.0f;
+    }
+    #pragma unroll
+    for (int i = 0; i < INS_BINS; ++i)
+    {
+        insDescNorm[i] = 0.0f;
+    }
+    #pragma unroll 4
+    for (int normId = 0; normId < 4; ++normId)
+    {
+        const float invNorm = normsLoc[normIds[normId]];
+        #pragma unroll
+        for (int i = 0; i < SENS_BINS; ++i)
+        {
+            sensDescNorm[i] += fmin(sensDesc[i] * invNorm, TRUNC);
+        }
+        descNorm[normId] = 0.0f;
+        #pragma unroll
+        for (int i = 0; i < INS_BINS; ++i)
+        {
+            const float tmp = fmin(insDesc[i] * invNorm, TRUNC);
+            insDescNorm[i] += tmp;
+            descNorm[normId] += tmp;
+        }
+    }
+
+    #pragma unroll
+    for (int i = 0; i < SENS_BINS; ++i)
+    {
+        storeDesc(sensDescNorm[i] * 0.5f, i, blockDescGlob);
+    }
+    #pragma unroll
+    for (int i = 0; i < INS_BINS; ++i)
+    {
+        storeDesc(insDescNorm[i] * 0.5f, SENS_BINS + i, blockDescGlob);
+    }
+    #pragma unroll 4
+    for (int i = 0; i < 4; ++i)
+    {
+        storeDesc(descNorm[i] * 0.2357f, SENS_BINS + INS_BINS + i, blockDescGlob);
+    }
+}
+
 __kernel void applyNormalization(
     __global const uint* restrict cellDescGlob,
     __global const float* restrict invBlockNormsGlob,
-    __global float* restrict blockDescGlob,
+    __global desc_t* restrict blockDescGlob,
     const int iterCnt,
     const int padX)
 {
@@ -339,17 +591,15 @@ __kernel void applyNormalization(
         blockDescGlob += mul24(cellIdLin, (int)BINS_PER_BLOCK);
     }
 
-    int loadIdLoc[2];
-    int loadIdGlob[2];
+    int loadIdLoc[NORMS_LOADS_PER_WI];
+    int loadIdGlob[NORMS_LOADS_PER_WI];
     {
         const int wiIdLin = mad24(wiId.y, (int)HOG_WG_SZ_SMALL, wiId.x);
-        const int normsLocSzLin = HOG_WG_SZ_SMALL_PAD * HOG_WG_SZ_SMALL_PAD;
-        loadIdLoc[0] = wiIdLin;
-        loadIdLoc[1] = wiIdLin + ((wiIdLin + HOG_WG_SZ_SMALL_LIN < normsLocSzLin) ?
-            HOG_WG_SZ_SMALL_LIN : 0);
-        #pragma unroll 2
-        for (int i = 0; i < 2; ++i)
+        #pragma unroll
+        for (int i = 0; i < NORMS_LOADS_PER_WI; ++i)
         {
+            loadIdLoc[i] = mad24(i, HOG_WG_SZ_SMALL_LIN, wiIdLin);
+            loadIdLoc[i] = loadIdLoc[i] >= HOG_WG_SZ_SMALL_PAD_LIN ? loadIdLoc[0] : loadIdLoc[i];
             const int2 loc = (int2)(
                 loadIdLoc[i] % HOG_WG_SZ_SMALL_PAD, loadIdLoc[i] / HOG_WG_SZ_SMALL_PAD);
             loadIdGlob[i] = mad24(loc.y, normsGlobSzX,
@@ -365,78 +615,143 @@ __kernel void applyNormalization(
         normIds[0] = normIds[1] + 1;
     }
 
-    float4 sensDesc[5];
-    float4 sensDescNorm[5];
-    float4 insDesc[3];
-    float4 insDescNorm[3];
-    float4 tmp;
-    float descNorm[4];
-
     for (int iter = 0, cellDescShift = 0; iter < iterCnt;
          ++iter, cellDescShift += cellBinCntPerIter, blockDescGlob += blockBinCntPerIter)
     {
         barrier(CLK_LOCAL_MEM_FENCE);
-        #pragma unroll 2
-        for (int i = 0; i < 2; ++i)
+        #pragma unroll
+        for (int i = 0; i < NORMS_LOADS_PER_WI; ++i)
         {
             normsLoc[loadIdLoc[i]] = invBlockNormsGlob[loadIdGlob[i]];
             loadIdGlob[i] += normsPerIter;
         }
 
         barrier(CLK_LOCAL_MEM_FENCE);
-        loadCellDesc(cellDescGlob + cellDescShift, sensDesc, insDesc);
-        #pragma unroll 4
-        for (int i = 0; i < 4; ++i)
-        {
-            sensDescNorm[i] = 0.0f;
-        }
-        sensDescNorm[4].s01 = 0.0f;
-        #pragma unroll 2
-        for (int i = 0; i < 2; ++i)
-        {
-            insDescNorm[i] = 0.0f;
-        }
-        insDescNorm[2].s0 = 0.0f;
-        #pragma unroll 4
-        for (int normId = 0; normId < 4; ++normId)
-        {
-            const float invNorm = normsLoc[normIds[normId]];
-            #pragma unroll 4
-            for (int i = 0; i < 4; ++i)
-            {
-                sensDescNorm[i] += fmin(sensDesc[i] * invNorm, TRUNC);
-            }
-            sensDescNorm[4].s01 += fmin(sensDesc[4].s01 * invNorm, TRUNC);
-            descNorm[normId] = 0.0f;
-            #pragma unroll 2
-            for (int i = 0; i < 2; ++i)
-            {
-                tmp = fmin(insDesc[i] * invNorm, TRUNC);
-                insDescNorm[i] += tmp;
-                descNorm[normId] += tmp.s0 + tmp.s1 + tmp.s2 + tmp.s3;
-            }
-            tmp.s0 = fmin(insDesc[2].s0 * invNorm, TRUNC);
-            insDescNorm[2].s0 += tmp.s0;
-            descNorm[normId] += tmp.s0;
-        }
+        normalizeCellInl(cellDescGlob + cellDescShift, normsLoc, normIds, blockDescGlob);
+    }
+}
 
-        #pragma unroll 4
-        for (int i = 0; i < 4; ++i)
-        {
-            vstore4(sensDescNorm[i] * 0.5f, i, blockDescGlob);
-        }
-        vstore2(sensDescNorm[4].s01 * 0.5f, 8, blockDescGlob);
-        #pragma unroll 2
-        for (int i = 0; i < 2; ++i)
+// calcInvBlockNorms fused into applyNormalization: the inverse norms of the blocks around the
+// cells of the work-group come from a halo of the cell norms written by calcCellDesc
+inline void normalizeBlocksBody(
+    __global const uint* restrict cellDescGlob,
+    __global const float* restrict cellNormsGlob,
+    __global desc_t* restrict blockDescGlob,
+    __local float* const restrict cellNormsLoc,
+    __local float* const restrict normsLoc,
+    const int cellCntGlobX,
+    const int iterCnt,
+    const int padX)
+{
+    const int2 wiId = (int2)(get_local_id(0), get_local_id(1));
+    const int wiIdLin = mad24(wiId.y, (int)HOG_WG_SZ_SMALL, wiId.x);
+    const int normsGlobSzX = cellCntGlobX + padX;
+    const int normsPerIter = mul24((int)HOG_WG_SZ_SMALL, normsGlobSzX);
+    const int cellsPerIter = mul24((int)HOG_WG_SZ_SMALL, cellCntGlobX);
+    const int cellBinCntPerIter = mul24(cellsPerIter, (int)SENS_BINS);
+    const int blockBinCntPerIter = mul24(cellsPerIter, (int)BINS_PER_BLOCK);
+
+    {
+        const int cellIdLin = mad24(wiId.y, cellCntGlobX, (int)get_global_id(0));
+        cellDescGlob += mul24(cellIdLin, (int)SENS_BINS);
+        blockDescGlob += mul24(cellIdLin, (int)BINS_PER_BLOCK);
+    }
+    cellNormsGlob += mul24((int)get_group_id(0), (int)HOG_WG_SZ_SMALL);
+
+    int normIds[4];
+    {
+        normIds[3] = mad24(wiId.y, HOG_WG_SZ_SMALL_PAD, wiId.x);
+        normIds[2] = normIds[3] + 1;
+        normIds[1] = normIds[3] + HOG_WG_SZ_SMALL_PAD;
+        normIds[0] = normIds[1] + 1;
+    }
+
+    for (int iter = 0, cellDescShift = 0; iter < iterCnt;
+         ++iter, cellDescShift += cellBinCntPerIter, blockDescGlob += blockBinCntPerIter,
+         cellNormsGlob += normsPerIter)
+    {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for (int i = wiIdLin; i < HOG_WG_SZ_SMALL_HALO_LIN; i += HOG_WG_SZ_SMALL_LIN)
         {
-            vstore4(insDescNorm[i] * 0.5f, i, blockDescGlob + 18);
+            cellNormsLoc[i] = cellNormsGlob[
+                mad24(i / HOG_WG_SZ_SMALL_HALO, normsGlobSzX, i % HOG_WG_SZ_SMALL_HALO)];
         }
-        blockDescGlob[26] = insDescNorm[2].s0 * 0.5f;
-        #pragma unroll 4
-        for (int i = 0; i < 4; ++i)
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+        // Summed in the order of calcInvBlockNorms
+        for (int i = wiIdLin; i < HOG_WG_SZ_SMALL_PAD_LIN; i += HOG_WG_SZ_SMALL_LIN)
         {
-            blockDescGlob[27 + i] = descNorm[i] * 0.2357f;
+            const int normId = i + i / HOG_WG_SZ_SMALL_PAD;
+            normsLoc[i] = half_rsqrt(
+                (cellNormsLoc[normId] + cellNormsLoc[normId + 1]) +
+                (cellNormsLoc[normId + HOG_WG_SZ_SMALL_HALO] +
+                cellNormsLoc[normId + HOG_WG_SZ_SMALL_HALO + 1]) + 1e-7f);
         }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+        normalizeCellInl(cellDescGlob + cellDescShift, normsLoc, normIds, blockDescGlob);
+    }
+}
+
+__kernel void normalizeBlocks(
+    __global const uint* const restrict cellDescGlob,
+    __global const float* const restrict cellNormsGlob,
+    __global desc_t* const restrict blockDescGlob,
+    const int iterCnt,
+    const int padX)
+{
+    __local float cellNormsLoc[HOG_WG_SZ_SMALL_HALO_LIN];
+    __local float normsLoc[HOG_WG_SZ_SMALL_PAD_LIN];
+    normalizeBlocksBody(cellDescGlob, cellNormsGlob, blockDescGlob, cellNormsLoc, normsLoc,
+        get_global_size(0), iterCnt, padX);
+}
+
+__kernel void normalizeBlocksPyramid(
+    __global const uint* const restrict cellDescGlob,
+    __global const float* const restrict cellNormsGlob,
+    __global desc_t* const restrict blockDescGlob,
+    __global const int* restrict scaleLayout)
+{
+    __local float cellNormsLoc[HOG_WG_SZ_SMALL_HALO_LIN];
+    __local float normsLoc[HOG_WG_SZ_SMALL_PAD_LIN];
+    scaleLayout += mul24((int)get_global_id(2), (int)SCALE_LAYOUT_SZ);
+    const int2 cellCnt = vload2(0, scaleLayout + SCALE_WIDTH) / CELL_SZ;
+    if (mul24((int)get_group_id(0), (int)HOG_WG_SZ_SMALL) >= cellCnt.x)
+    {
+        return;
     }
+    const int cellOffset = scaleLayout[SCALE_CELL_OFFSET];
+    normalizeBlocksBody(cellDescGlob + mul24(cellOffset, (int)SENS_BINS),
+        cellNormsGlob + scaleLayout[SCALE_NORMS_OFFSET],
+        blockDescGlob + mul24(cellOffset, (int)BINS_PER_BLOCK), cellNormsLoc, normsLoc,
+        cellCnt.x, cellCnt.y / HOG_WG_SZ_SMALL, 2);
 }
 
+// Bilinear resampling of the srcSz image into every scale of a pyramid, pixel centres aligned
+__kernel void resampleScales(
+    __global const float* const restrict srcGlob,
+    __global float* const restrict dstGlob,
+    __global const int* restrict scaleLayout,
+    const int2 srcSz)
+{
+    scaleLayout += mul24((int)get_global_id(2), (int)SCALE_LAYOUT_SZ);
+    const int2 dstSz = vload2(0, scaleLayout + SCALE_WIDTH);
+    const int2 dstId = (int2)(get_global_id(0), get_global_id(1));
+    if (dstId.x >= dstSz.x || dstId.y >= dstSz.y)
+    {
+        return;
+    }
+    const float2 srcPos = clamp(
+        (convert_float2(dstId) + 0.5f) * convert_float2(srcSz) / convert_float2(dstSz) - 0.5f,
+        (float2)(0.0f), convert_float2(srcSz - 1));
+    const int2 srcId = convert_int2(srcPos);
+    const int2 nextId = min(srcId + 1, srcSz - 1);
+    const float2 weight = srcPos - convert_float2(srcId);
+    const int2 rows = mul24((int2)(srcId.y, nextId.y), srcSz.x);
+    const float top = srcGlob[rows.s0 + srcId.x] +
+        (srcGlob[rows.s0 + nextId.x] - srcGlob[rows.s0 + srcId.x]) * weight.x;
+    const float bottom = srcGlob[rows.s1 + srcId.x] +
+        (srcGlob[rows.s1 + nextId.x] - srcGlob[rows.s1 + srcId.x]) * weight.x;
+    dstGlob[scaleLayout[SCALE_IM_OFFSET] + mad24(dstId.y, dstSz.x, dstId.x)] =
+        top + (bottom - top) * weight.y;
+}
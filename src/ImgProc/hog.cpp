@@ -1,6 +1,78 @@
 #include <hog.h>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
 #include <vector>
 
+HogProgramCache::~HogProgramCache()
+{
+    release();
+}
+
+void HogProgramCache::initialize(
+    cl_context context,
+    const std::string &source,
+    cl_program defaultProgram)
+{
+    release();
+    context_ = context;
+    source_ = source;
+    if (defaultProgram && clRetainProgram(defaultProgram) == CL_SUCCESS)
+    {
+        programs_[buildOptions(HogSettings())] = defaultProgram;
+    }
+}
+
+void HogProgramCache::release()
+{
+    for (auto &program : programs_)
+    {
+        clReleaseProgram(program.second);
+    }
+    programs_.clear();
+    context_ = NULL;
+    source_.clear();
+}
+
+cl_int HogProgramCache::program(const HogSettings &settings, cl_program &program)
+{
+    std::string options = buildOptions(settings);
+    auto cached = programs_.find(options);
+    if (cached != programs_.end())
+    {
+        program = cached->second;
+        return CL_SUCCESS;
+    }
+    const char *source[] = { source_.c_str() };
+    program = clCreateProgramWithSource(context_, 1, source, NULL, NULL);
+    if (!program)
+    {
+        return CL_INVALID_PROGRAM;
+    }
+    cl_int status = clBuildProgram(program, 0, NULL, options.c_str(), NULL, NULL);
+    if (status != CL_SUCCESS)
+    {
+        clReleaseProgram(program);
+        program = NULL;
+        return status;
+    }
+    programs_[options] = program;
+    return CL_SUCCESS;
+}
+
+std::string HogProgramCache::buildOptions(const HogSettings &settings)
+{
+    // Every digit of the truncation, so that hog.cl gets the float of the settings
+    std::ostringstream options;
+    options << "-cl-std=CL1.2 -D SENS_BINS=" << settings.sensitiveBinCount() <<
+        " -D HALF_CELL_SZ=" << settings.cellSize_ / 2 <<
+        " -D HOG_WG_SZ_BIG=" << settings.wgSize_[0] <<
+        " -D DESC_FORMAT=" << (int)settings.descriptorFormat_ <<
+        " -D TRUNC=" << std::showpoint << std::setprecision(9) << settings.truncation_ << "f";
+    return options.str();
+}
+
 CellHog::~CellHog()
 {
     release();
@@ -17,9 +89,10 @@ cl_int CellHog::initialize(
     {
         kernel_.ndrangeLoc_[i] = settings.wgSize_[i];
     }
-    kernel_.ndrangeGlob_[0] = settings.imWidth();
     kernel_.ndrangeGlob_[1] = kernel_.ndrangeLoc_[1];
-    if (kernel_.ndrangeGlob_[0] % kernel_.ndrangeLoc_[0] ||
+    // One HOG_WG_SZ_BIG in hog.cl, covering whole cells
+    if (settings.wgSize_[0] != settings.wgSize_[1] || settings.wgSize_[0] % settings.cellSize_ ||
+        settings.imWidth() % kernel_.ndrangeLoc_[0] ||
         settings.imHeight() % kernel_.ndrangeLoc_[1])
     {
         return CL_INVALID_WORK_GROUP_SIZE;
@@ -28,7 +101,17 @@ cl_int CellHog::initialize(
     int bytes = settings.cellCount_[0] * settings.cellCount_[1] * settings.sensitiveBinCount() *
         sizeof(cl_uint);
     descriptor_ = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
-    if (descriptor_)
+    if (descriptor_ && settings.fusedKernels_)
+    {
+        // One zero cell on each side for the blocks at the borders
+        padding_ = { 2, 2 };
+        size_t normsBytes = (settings.cellCount_[0] + padding_.x) *
+            (settings.cellCount_[1] + padding_.y) * sizeof(cl_float);
+        std::vector<float> zeros(normsBytes / sizeof(cl_float), 0.0f);
+        cellNorms_ = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+            normsBytes, zeros.data(), NULL);
+    }
+    if (descriptor_ && (cellNorms_ || !settings.fusedKernels_))
     {
         kernel_.kernel_ = clCreateKernel(program, "calcCellDesc", NULL);
     }
@@ -41,8 +124,31 @@ cl_int CellHog::initialize(
     int argId = 0;
     cl_int status = clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_mem), &image);
     status |= clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_mem), &descriptor_);
-    int iterationsCount = settings.imHeight() / kernel_.ndrangeLoc_[1];
-    status |= clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_int), &iterationsCount);
+    status |= clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_mem), &cellNorms_);
+    int fastBinning = settings.fastBinning_;
+    status |= clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_int), &fastBinning);
+    int imageStride = settings.imWidth();
+    status |= clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_int), &imageStride);
+    if (status == CL_SUCCESS)
+    {
+        status = setRoi(cl_int4{ { 0, 0, settings.imWidth(), settings.imHeight() } });
+    }
+    return status;
+}
+
+cl_int CellHog::setRoi(const cl_int4 &roi)
+{
+    if (roi.s[2] % kernel_.ndrangeLoc_[0] || roi.s[3] % kernel_.ndrangeLoc_[1])
+    {
+        return CL_INVALID_WORK_GROUP_SIZE;
+    }
+    kernel_.ndrangeGlob_[0] = roi.s[2];
+    // After the arguments set by initialize
+    int argId = 5;
+    int iterationsCount = roi.s[3] / kernel_.ndrangeLoc_[1];
+    cl_int status = clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_int), &iterationsCount);
+    cl_int2 offset = { { roi.s[0], roi.s[1] } };
+    status |= clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_int2), &offset);
     return status;
 }
 
@@ -54,6 +160,11 @@ void CellHog::release()
         clReleaseMemObject(descriptor_);
         descriptor_ = NULL;
     }
+    if (cellNorms_)
+    {
+        clReleaseMemObject(cellNorms_);
+        cellNorms_ = NULL;
+    }
 }
 
 cl_int CellHog::calculate(
@@ -77,13 +188,8 @@ cl_int CellNorm::initialize(
     cl_mem sensitiveCellDescriptor)
 {
     kernel_.dim_ = 2;
-    kernel_.ndrangeLoc_[0] = kernel_.ndrangeLoc_[1] = 4;
-    if (settings.cellCount_[0] % kernel_.ndrangeLoc_[0] ||
-        settings.cellCount_[1] % kernel_.ndrangeLoc_[1])
-    {
-        return CL_INVALID_WORK_GROUP_SIZE;
-    }
-    kernel_.ndrangeGlob_[0] = settings.cellCount_[0];
+    // HOG_WG_SZ_SMALL, the cells of a work-group of calcCellDesc
+    kernel_.ndrangeLoc_[0] = kernel_.ndrangeLoc_[1] = settings.wgSize_[0] / settings.cellSize_;
     kernel_.ndrangeGlob_[1] = kernel_.ndrangeLoc_[1];
     padding_ = { (int)kernel_.ndrangeLoc_[0] + 1, (int)kernel_.ndrangeLoc_[1] + 1 };
 
@@ -107,11 +213,24 @@ cl_int CellNorm::initialize(
     int argId = 0;
     cl_int status = clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_mem), &sensitiveCellDescriptor);
     status |= clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_mem), &cellNorms_);
-    int iterationsCount = settings.cellCount_[1] / kernel_.ndrangeLoc_[1];
-    status |= clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_int), &iterationsCount);
+    if (status == CL_SUCCESS)
+    {
+        status = resize(settings.cellCount_);
+    }
     return status;
 }
 
+cl_int CellNorm::resize(const int cellCount[2])
+{
+    if (cellCount[0] % kernel_.ndrangeLoc_[0] || cellCount[1] % kernel_.ndrangeLoc_[1])
+    {
+        return CL_INVALID_WORK_GROUP_SIZE;
+    }
+    kernel_.ndrangeGlob_[0] = cellCount[0];
+    int iterationsCount = cellCount[1] / kernel_.ndrangeLoc_[1];
+    return clSetKernelArg(kernel_.kernel_, 2, sizeof(cl_int), &iterationsCount);
+}
+
 void CellNorm::release()
 {
     kernel_.release();
@@ -144,14 +263,8 @@ cl_int InvBlockNorm::initialize(
     cl_mem cellNorms)
 {
     kernel_.dim_ = 2;
-    kernel_.ndrangeLoc_[0] = kernel_.ndrangeLoc_[1] = 4;
-    kernel_.ndrangeGlob_[0] = settings.cellCount_[0] + padding.x - 1;
+    kernel_.ndrangeLoc_[0] = kernel_.ndrangeLoc_[1] = settings.wgSize_[0] / settings.cellSize_;
     kernel_.ndrangeGlob_[1] = kernel_.ndrangeLoc_[1];
-    if (kernel_.ndrangeGlob_[0] % kernel_.ndrangeLoc_[0] ||
-        (settings.cellCount_[1] + padding.y - 1) % kernel_.ndrangeLoc_[1])
-    {
-        return CL_INVALID_WORK_GROUP_SIZE;
-    }
 
     size_t bytes = (settings.cellCount_[0] + padding.x) * (settings.cellCount_[1] + padding.y) *
         sizeof(cl_float);
@@ -173,11 +286,25 @@ cl_int InvBlockNorm::initialize(
     int argId = 0;
     cl_int status = clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_mem), &cellNorms);
     status |= clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_mem), &invBlockNorms_);
-    int iterationsCount = (settings.cellCount_[1] + padding.y - 1) / kernel_.ndrangeLoc_[1];
-    status |= clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_int), &iterationsCount);
+    if (status == CL_SUCCESS)
+    {
+        status = resize(settings.cellCount_, padding);
+    }
     return status;
 }
 
+cl_int InvBlockNorm::resize(const int cellCount[2], const cl_int2 &padding)
+{
+    if ((cellCount[0] + padding.x - 1) % kernel_.ndrangeLoc_[0] ||
+        (cellCount[1] + padding.y - 1) % kernel_.ndrangeLoc_[1])
+    {
+        return CL_INVALID_WORK_GROUP_SIZE;
+    }
+    kernel_.ndrangeGlob_[0] = cellCount[0] + padding.x - 1;
+    int iterationsCount = (cellCount[1] + padding.y - 1) / kernel_.ndrangeLoc_[1];
+    return clSetKernelArg(kernel_.kernel_, 2, sizeof(cl_int), &iterationsCount);
+}
+
 void InvBlockNorm::release()
 {
     kernel_.release();
@@ -208,23 +335,18 @@ cl_int BlockHog::initialize(
     cl_context context,
     cl_program program,
     cl_mem cellDesc,
-    cl_mem invBlockNorms)
+    cl_mem norms)
 {
     kernel_.dim_ = 2;
-    kernel_.ndrangeLoc_[0] = kernel_.ndrangeLoc_[1] = 4;
-    kernel_.ndrangeGlob_[0] = settings.cellCount_[0];
+    kernel_.ndrangeLoc_[0] = kernel_.ndrangeLoc_[1] = settings.wgSize_[0] / settings.cellSize_;
     kernel_.ndrangeGlob_[1] = kernel_.ndrangeLoc_[1];
-    if (kernel_.ndrangeGlob_[0] % kernel_.ndrangeLoc_[0] ||
-        settings.cellCount_[1] % kernel_.ndrangeLoc_[1])
-    {
-        return CL_INVALID_WORK_GROUP_SIZE;
-    }
 
-    size_t bytes = settings.descLen() * sizeof(cl_float);
+    size_t bytes = settings.descLen() * settings.descriptorElementSize();
     descriptor_ = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, NULL);
     if (descriptor_)
     {
-        kernel_.kernel_ = clCreateKernel(program, "applyNormalization", NULL);
+        kernel_.kernel_ = clCreateKernel(program,
+            settings.fusedKernels_ ? "normalizeBlocks" : "applyNormalization", NULL);
     }
     if (!kernel_.kernel_)
     {
@@ -234,14 +356,29 @@ cl_int BlockHog::initialize(
 
     int argId = 0;
     cl_int status = clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_mem), &cellDesc);
-    status |= clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_mem), &invBlockNorms);
+    status |= clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_mem), &norms);
     status |= clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_mem), &descriptor_);
-    int iterationsCount = settings.cellCount_[1] / kernel_.ndrangeLoc_[1];
-    status |= clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_int), &iterationsCount);
+    // The iteration count is set by resize
+    argId++;
     status |= clSetKernelArg(kernel_.kernel_, argId++, sizeof(cl_int), &padding.x);
+    if (status == CL_SUCCESS)
+    {
+        status = resize(settings.cellCount_);
+    }
     return status;
 }
 
+cl_int BlockHog::resize(const int cellCount[2])
+{
+    if (cellCount[0] % kernel_.ndrangeLoc_[0] || cellCount[1] % kernel_.ndrangeLoc_[1])
+    {
+        return CL_INVALID_WORK_GROUP_SIZE;
+    }
+    kernel_.ndrangeGlob_[0] = cellCount[0];
+    int iterationsCount = cellCount[1] / kernel_.ndrangeLoc_[1];
+    return clSetKernelArg(kernel_.kernel_, 3, sizeof(cl_int), &iterationsCount);
+}
+
 void BlockHog::release()
 {
     kernel_.release();
@@ -261,6 +398,46 @@ cl_int BlockHog::calculate(
     return kernel_.calculate(queue, numWaitEvents, waitList, event);
 }
 
+static float halfToFloat(cl_half value)
+{
+    int exponent = (value >> 10) & 0x1f;
+    int mantissa = value & 0x3ff;
+    float magnitude = exponent ?
+        ldexpf((float)(mantissa | 0x400), exponent - 25) : ldexpf((float)mantissa, -24);
+    if (exponent == 0x1f)
+    {
+        magnitude = mantissa ? NAN : INFINITY;
+    }
+    return (value & 0x8000) ? -magnitude : magnitude;
+}
+
+void BlockHog::unpackDescriptor(
+    const HogSettings &settings,
+    const void *packed,
+    int count,
+    float *desc)
+{
+    switch (settings.descriptorFormat_)
+    {
+    case HogDescriptorFormat::float16:
+    {
+        const cl_half *halves = (const cl_half*)packed;
+        std::transform(halves, halves + count, desc, halfToFloat);
+        break;
+    }
+    case HogDescriptorFormat::uint8:
+    {
+        const cl_uchar *bytes = (const cl_uchar*)packed;
+        float scale = settings.maxDescriptorValue() / 255.0f;
+        std::transform(bytes, bytes + count, desc,
+            [scale](cl_uchar value) { return value * scale; });
+        break;
+    }
+    default:
+        std::copy((const float*)packed, (const float*)packed + count, desc);
+    }
+}
+
 Hog::~Hog()
 {
     release();
@@ -272,7 +449,14 @@ cl_int Hog::initialize(
     cl_program program,
     cl_mem image)
 {
+    settings_ = settings;
+    roi_ = { { 0, 0, settings.imWidth(), settings.imHeight() } };
     cl_int status = cellHog_.initialize(settings, context, program, image);
+    if (status == CL_SUCCESS && settings.fusedKernels_)
+    {
+        return blockHog_.initialize(settings, cellHog_.padding_, context, program,
+            cellHog_.descriptor_, cellHog_.cellNorms_);
+    }
     if (status == CL_SUCCESS)
     {
         status = cellNorm_.initialize(settings, context, program, cellHog_.descriptor_);
@@ -304,8 +488,50 @@ cl_int Hog::calculate(
     const cl_event *waitList,
     cl_event &event)
 {
+    cl_int4 image = { { 0, 0, settings_.imWidth(), settings_.imHeight() } };
+    return calculate(queue, image, numWaitEvents, waitList, event);
+}
+
+cl_int Hog::calculate(
+    cl_command_queue queue,
+    const cl_int4 &roi,
+    cl_int numWaitEvents,
+    const cl_event *waitList,
+    cl_event &event)
+{
+    bool resized = roi.s[2] != roi_.s[2] || roi.s[3] != roi_.s[3];
+    cl_int status = setRoi(roi);
+    // The zero padding of the cell norms may hold norms of the previous size
+    cl_event clearEvent = NULL;
+    if (status == CL_SUCCESS && resized)
+    {
+        status = clearCellNorms(queue, numWaitEvents, waitList, clearEvent);
+        numWaitEvents = 1;
+        waitList = &clearEvent;
+    }
     cl_event cellHogEvent = NULL;
-    cl_int status = cellHog_.calculate(queue, numWaitEvents, waitList, cellHogEvent);
+    if (status == CL_SUCCESS)
+    {
+        status = cellHog_.calculate(queue, numWaitEvents, waitList, cellHogEvent);
+    }
+    if (clearEvent)
+    {
+        clReleaseEvent(clearEvent);
+        clearEvent = NULL;
+    }
+    if (cellHog_.cellNorms_)
+    {
+        if (status == CL_SUCCESS)
+        {
+            status = blockHog_.calculate(queue, 1, &cellHogEvent, event);
+        }
+        if (cellHogEvent)
+        {
+            clReleaseEvent(cellHogEvent);
+            cellHogEvent = NULL;
+        }
+        return status;
+    }
     cl_event cellNormEvent = NULL;
     if (status == CL_SUCCESS)
     {
@@ -338,3 +564,221 @@ cl_int Hog::calculate(
     return status;
 }
 
+cl_int Hog::setRoi(const cl_int4 &roi)
+{
+    int cellSize = settings_.cellSize_;
+    if (roi.s[0] < 0 || roi.s[1] < 0 || roi.s[0] % cellSize || roi.s[1] % cellSize ||
+        roi.s[2] <= 0 || roi.s[3] < 2 * settings_.wgSize_[1] ||
+        roi.s[0] + roi.s[2] > settings_.imWidth() || roi.s[1] + roi.s[3] > settings_.imHeight())
+    {
+        return CL_INVALID_VALUE;
+    }
+    int cellCount[2] = { roi.s[2] / cellSize, roi.s[3] / cellSize };
+    cl_int status = cellHog_.setRoi(roi);
+    if (status == CL_SUCCESS && !settings_.fusedKernels_)
+    {
+        status = cellNorm_.resize(cellCount);
+    }
+    if (status == CL_SUCCESS && !settings_.fusedKernels_)
+    {
+        status = invBlockNorm_.resize(cellCount, cellNorm_.padding_);
+    }
+    if (status == CL_SUCCESS)
+    {
+        status = blockHog_.resize(cellCount);
+    }
+    if (status == CL_SUCCESS)
+    {
+        roi_ = roi;
+    }
+    return status;
+}
+
+cl_int Hog::clearCellNorms(
+    cl_command_queue queue,
+    cl_int numWaitEvents,
+    const cl_event *waitList,
+    cl_event &event)
+{
+    cl_mem cellNorms = settings_.fusedKernels_ ? cellHog_.cellNorms_ : cellNorm_.cellNorms_;
+    const cl_int2 &padding = settings_.fusedKernels_ ? cellHog_.padding_ : cellNorm_.padding_;
+    size_t bytes = (settings_.cellCount_[0] + padding.x) * (settings_.cellCount_[1] + padding.y) *
+        sizeof(cl_float);
+    cl_float zero = 0.0f;
+    return clEnqueueFillBuffer(queue, cellNorms, &zero, sizeof(cl_float), 0, bytes,
+        numWaitEvents, waitList, &event);
+}
+
+HogPyramid::~HogPyramid()
+{
+    release();
+}
+
+cl_int HogPyramid::initialize(
+    const HogSettings &settings,
+    const std::vector<float> &scales,
+    cl_context context,
+    cl_program program,
+    cl_mem image)
+{
+    release();
+    if (scales.empty())
+    {
+        return CL_INVALID_VALUE;
+    }
+    if (settings.wgSize_[0] != settings.wgSize_[1] || settings.wgSize_[0] % settings.cellSize_)
+    {
+        return CL_INVALID_WORK_GROUP_SIZE;
+    }
+
+    // Per scale, like SCALE_IM_OFFSET .. SCALE_NORMS_OFFSET in hog.cl
+    std::vector<cl_int> layout;
+    int imageLength = 0;
+    int cellCount = 0;
+    int normsLength = 0;
+    int maxWidth = 0;
+    int maxHeight = 0;
+    for (float scale : scales)
+    {
+        int width = std::max((int)lroundf(settings.imWidth() * scale / settings.wgSize_[0]), 1) *
+            settings.wgSize_[0];
+        int height = std::max((int)lroundf(settings.imHeight() * scale / settings.wgSize_[1]),
+            2) * settings.wgSize_[1];
+        HogSettings scaleSettings = settings;
+        if (!scaleSettings.init(width, height))
+        {
+            release();
+            return CL_INVALID_VALUE;
+        }
+        layout.insert(layout.end(), { imageLength, width, height, cellCount, normsLength });
+        imageOffsets_.push_back(imageLength);
+        cellOffsets_.push_back(cellCount);
+        scaleSettings_.push_back(scaleSettings);
+        imageLength += width * height;
+        cellCount += scaleSettings.cellCount_[0] * scaleSettings.cellCount_[1];
+        // One zero cell on each side like CellHog::cellNorms_
+        normsLength += (scaleSettings.cellCount_[0] + 2) * (scaleSettings.cellCount_[1] + 2);
+        maxWidth = std::max(maxWidth, width);
+        maxHeight = std::max(maxHeight, height);
+    }
+
+    scaleLayout_ = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+        layout.size() * sizeof(cl_int), layout.data(), NULL);
+    scaledImages_ = clCreateBuffer(context, CL_MEM_READ_WRITE, imageLength * sizeof(cl_float),
+        NULL, NULL);
+    cellDescriptor_ = clCreateBuffer(context, CL_MEM_READ_WRITE,
+        cellCount * settings.sensitiveBinCount() * sizeof(cl_uint), NULL, NULL);
+    {
+        std::vector<float> zeros(normsLength, 0.0f);
+        cellNorms_ = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+            normsLength * sizeof(cl_float), zeros.data(), NULL);
+    }
+    descriptor_ = clCreateBuffer(context, CL_MEM_READ_WRITE,
+        cellCount * settings.channelsPerBlock() * settings.descriptorElementSize(), NULL, NULL);
+    if (scaleLayout_ && scaledImages_ && cellDescriptor_ && cellNorms_ && descriptor_)
+    {
+        resample_.kernel_ = clCreateKernel(program, "resampleScales", NULL);
+        cellHog_.kernel_ = clCreateKernel(program, "calcCellDescPyramid", NULL);
+        blockHog_.kernel_ = clCreateKernel(program, "normalizeBlocksPyramid", NULL);
+    }
+    if (!resample_.kernel_ || !cellHog_.kernel_ || !blockHog_.kernel_)
+    {
+        release();
+        return CL_INVALID_KERNEL;
+    }
+
+    cl_uint scaleCount = scales.size();
+    resample_.dim_ = 3;
+    for (int i = 0; i < 2; ++i)
+    {
+        resample_.ndrangeLoc_[i] = cellHog_.ndrangeLoc_[i] = settings.wgSize_[i];
+    }
+    resample_.ndrangeLoc_[2] = 1;
+    resample_.ndrangeGlob_[0] = maxWidth;
+    resample_.ndrangeGlob_[1] = maxHeight;
+    resample_.ndrangeGlob_[2] = scaleCount;
+
+    cellHog_.dim_ = 3;
+    cellHog_.ndrangeLoc_[2] = 1;
+    cellHog_.ndrangeGlob_[0] = maxWidth;
+    cellHog_.ndrangeGlob_[1] = cellHog_.ndrangeLoc_[1];
+    cellHog_.ndrangeGlob_[2] = scaleCount;
+
+    blockHog_.dim_ = 3;
+    blockHog_.ndrangeLoc_[0] = blockHog_.ndrangeLoc_[1] = settings.wgSize_[0] / settings.cellSize_;
+    blockHog_.ndrangeLoc_[2] = 1;
+    blockHog_.ndrangeGlob_[0] = maxWidth / settings.cellSize_;
+    blockHog_.ndrangeGlob_[1] = blockHog_.ndrangeLoc_[1];
+    blockHog_.ndrangeGlob_[2] = scaleCount;
+
+    int argId = 0;
+    cl_int status = clSetKernelArg(resample_.kernel_, argId++, sizeof(cl_mem), &image);
+    status |= clSetKernelArg(resample_.kernel_, argId++, sizeof(cl_mem), &scaledImages_);
+    status |= clSetKernelArg(resample_.kernel_, argId++, sizeof(cl_mem), &scaleLayout_);
+    cl_int2 imageSize = { { settings.imWidth(), settings.imHeight() } };
+    status |= clSetKernelArg(resample_.kernel_, argId++, sizeof(cl_int2), &imageSize);
+
+    argId = 0;
+    status |= clSetKernelArg(cellHog_.kernel_, argId++, sizeof(cl_mem), &scaledImages_);
+    status |= clSetKernelArg(cellHog_.kernel_, argId++, sizeof(cl_mem), &cellDescriptor_);
+    status |= clSetKernelArg(cellHog_.kernel_, argId++, sizeof(cl_mem), &cellNorms_);
+    status |= clSetKernelArg(cellHog_.kernel_, argId++, sizeof(cl_mem), &scaleLayout_);
+    int fastBinning = settings.fastBinning_;
+    status |= clSetKernelArg(cellHog_.kernel_, argId++, sizeof(cl_int), &fastBinning);
+
+    argId = 0;
+    status |= clSetKernelArg(blockHog_.kernel_, argId++, sizeof(cl_mem), &cellDescriptor_);
+    status |= clSetKernelArg(blockHog_.kernel_, argId++, sizeof(cl_mem), &cellNorms_);
+    status |= clSetKernelArg(blockHog_.kernel_, argId++, sizeof(cl_mem), &descriptor_);
+    status |= clSetKernelArg(blockHog_.kernel_, argId++, sizeof(cl_mem), &scaleLayout_);
+    return status;
+}
+
+void HogPyramid::release()
+{
+    resample_.release();
+    cellHog_.release();
+    blockHog_.release();
+    for (cl_mem *buffer : { &scaleLayout_, &scaledImages_, &cellDescriptor_, &cellNorms_,
+        &descriptor_ })
+    {
+        if (*buffer)
+        {
+            clReleaseMemObject(*buffer);
+            *buffer = NULL;
+        }
+    }
+    scaleSettings_.clear();
+    imageOffsets_.clear();
+    cellOffsets_.clear();
+}
+
+cl_int HogPyramid::calculate(
+    cl_command_queue queue,
+    cl_int numWaitEvents,
+    const cl_event *waitList,
+    cl_event &event)
+{
+    cl_event resampleEvent = NULL;
+    cl_int status = resample_.calculate(queue, numWaitEvents, waitList, resampleEvent);
+    cl_event cellHogEvent = NULL;
+    if (status == CL_SUCCESS)
+    {
+        status = cellHog_.calculate(queue, 1, &resampleEvent, cellHogEvent);
+    }
+    if (resampleEvent)
+    {
+        clReleaseEvent(resampleEvent);
+        resampleEvent = NULL;
+    }
+    if (status == CL_SUCCESS)
+    {
+        status = blockHog_.calculate(queue, 1, &cellHogEvent, event);
+    }
+    if (cellHogEvent)
+    {
+        clReleaseEvent(cellHogEvent);
+        cellHogEvent = NULL;
+    }
+    return status;
+}
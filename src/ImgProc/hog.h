@@ -2,9 +2,40 @@
 #define HOG_H
 
 #include <array>
+#include <map>
+#include <string>
+#include <vector>
 #include <hogproto.h>
 #include <rangedkernel.h>
 
+// hog.cl built once per configuration of HogSettings: its cell size, bin count, truncation and
+// work-group size are passed as -D options, the programs kept until release. The context and
+// the source (hog.cl, possibly among other files) are the ones of the caller, e.g.
+//     cache.initialize(oclContext_, getKernelSource(), oclProgram_);
+//     cache.program(settings, program);
+//     hog.initialize(settings, oclContext_, program, image);
+// defaultProgram, the source already built without -D options, is then used for the default
+// HogSettings (the defaults of hog.cl) instead of a second build. The cache retains it.
+class HogProgramCache
+{
+public:
+    ~HogProgramCache();
+    void initialize(
+        cl_context context,
+        const std::string &source,
+        cl_program defaultProgram = NULL);
+    void release();
+    // The program stays owned by the cache
+    cl_int program(const HogSettings &settings, cl_program &program);
+
+    static std::string buildOptions(const HogSettings &settings);
+
+protected:
+    cl_context context_ = NULL;
+    std::string source_;
+    std::map<std::string, cl_program> programs_;
+};
+
 class CellHog
 {
 public:
@@ -15,6 +46,8 @@ public:
         cl_program program,
         cl_mem image);
     void release();
+    // The rectangle (x, y, width, height) in pixels, processed as if it were the whole image
+    cl_int setRoi(const cl_int4 &roi);
     cl_int calculate(
         cl_command_queue queue,
         cl_int numWaitEvents,
@@ -22,6 +55,9 @@ public:
         cl_event &event);
 
     cl_mem descriptor_ = NULL;
+    // With HogSettings::fusedKernels_ only: the cell norms, padded like CellNorm::cellNorms_
+    cl_int2 padding_ = cl_int2{0, 0};
+    cl_mem cellNorms_ = NULL;
     RangedKernel kernel_;
 };
 
@@ -35,6 +71,7 @@ public:
         cl_program program,
         cl_mem sensitiveCellDescriptor);
     void release();
+    cl_int resize(const int cellCount[2]);
     cl_int calculate(
         cl_command_queue queue,
         cl_int numWaitEvents,
@@ -57,6 +94,7 @@ public:
         cl_program program,
         cl_mem cellNorms);
     void release();
+    cl_int resize(const int cellCount[2], const cl_int2 &padding);
     cl_int calculate(
         cl_command_queue queue,
         cl_int numWaitEvents,
@@ -67,6 +105,9 @@ public:
     RangedKernel kernel_;
 };
 
+// Normalizes by invBlockNorms, or with HogSettings::fusedKernels_ by the cell norms of
+// CellHog, computing the inverse block norms itself. descriptor_ holds the values in
+// HogSettings::descriptorFormat_
 class BlockHog
 {
 public:
@@ -77,13 +118,20 @@ public:
         cl_context context,
         cl_program program,
         cl_mem cellDesc,
-        cl_mem invBlockNorms);
+        cl_mem norms);
     void release();
+    cl_int resize(const int cellCount[2]);
     cl_int calculate(
         cl_command_queue queue,
         cl_int numWaitEvents,
         const cl_event *waitList,
         cl_event &event);
+    // count values of descriptor_ read back as floats
+    static void unpackDescriptor(
+        const HogSettings &settings,
+        const void *packed,
+        int count,
+        float *desc);
 
     cl_mem descriptor_ = NULL;
     RangedKernel kernel_;
@@ -104,11 +152,71 @@ public:
         cl_int numWaitEvents,
         const cl_event *waitList,
         cl_event &event);
+    // Only the cell-aligned rectangle roi (x, y, width, height in pixels) of the image, as if
+    // it were the whole image: blockHog_.descriptor_ then holds the width / cellSize_ x
+    // height / cellSize_ cells of the roi. The size is a multiple of wgSize_, the height at
+    // least two work-groups.
+    cl_int calculate(
+        cl_command_queue queue,
+        const cl_int4 &roi,
+        cl_int numWaitEvents,
+        const cl_event *waitList,
+        cl_event &event);
 
     CellHog cellHog_;
     CellNorm cellNorm_;
     InvBlockNorm invBlockNorm_;
     BlockHog blockHog_;
+
+protected:
+    cl_int setRoi(const cl_int4 &roi);
+    cl_int clearCellNorms(
+        cl_command_queue queue,
+        cl_int numWaitEvents,
+        const cl_event *waitList,
+        cl_event &event);
+
+    HogSettings settings_;
+    cl_int4 roi_ = cl_int4{ { 0, 0, 0, 0 } };
+};
+
+// HOG of the image resampled to several scales, resampleScales, calcCellDescPyramid and
+// normalizeBlocksPyramid covering every scale in one launch each: the scale is the third
+// NDRange dimension. The scales follow one another in every buffer, scale i starting at
+// imageOffsets_[i] in scaledImages_ and at cell cellOffsets_[i] in descriptor_ (cell-major,
+// channelsPerBlock() values per cell in descriptorFormat_ like BlockHog::descriptor_).
+class HogPyramid
+{
+public:
+    ~HogPyramid();
+    // Scale i is the image resized by scales[i], rounded to multiples of wgSize_ and at least
+    // two work-groups high
+    cl_int initialize(
+        const HogSettings &settings,
+        const std::vector<float> &scales,
+        cl_context context,
+        cl_program program,
+        cl_mem image);
+    void release();
+    cl_int calculate(
+        cl_command_queue queue,
+        cl_int numWaitEvents,
+        const cl_event *waitList,
+        cl_event &event);
+
+    std::vector<HogSettings> scaleSettings_;
+    std::vector<int> imageOffsets_;
+    std::vector<int> cellOffsets_;
+    cl_mem scaledImages_ = NULL;
+    cl_mem cellDescriptor_ = NULL;
+    cl_mem cellNorms_ = NULL;
+    cl_mem descriptor_ = NULL;
+
+protected:
+    cl_mem scaleLayout_ = NULL;
+    RangedKernel resample_;
+    RangedKernel cellHog_;
+    RangedKernel blockHog_;
 };
 
 #endif // HOG_H
@@ -1,5 +1,7 @@
 #include <hogproto.h>
 #include <algorithm>
+#include <cstring>
+#include <threadpool.h>
 
 const float M_PI_FLOAT = (float)M_PI;
 
@@ -14,23 +16,18 @@ inline float getPixel(const float *image, const int size[2], int x, int y)
     return isValid ? image[x + y * size[0]] : 0.0f;
 }
 
-inline float getPixelDerivs(const float *image, const int size[2], int x, int y)
+// Inverse norm of the 2x2 block whose top-left cell is (x, y), cells outside the image
+// counting as zero
+inline float getBlockInverseNorm(
+    const float *cellSquaredNorms, const int cellCount[2],
+    int x, int y)
 {
-    int isValid = (x >= -1) & (x <= size[0]) & (y >= -1) & (y <= size[1]);
-    x = clamp(x, 0, size[0] - 1);
-    y = clamp(y, 0, size[1] - 1);
-    return isValid ? image[x + y * size[0]] : 0.0f;
-}
-
-inline void setPixel(
-    float *image, float value,
-    const int size[2], int channels,
-    int x, int y, int channel)
-{
-    int xClamped = clamp(x, 0, size[0] - 1);
-    int yClamped = clamp(y, 0, size[1] - 1);
-    int pixelIndex = (xClamped + yClamped * size[0]) * channels + channel;
-    image[pixelIndex] = (x == xClamped && y == yClamped) ? value : image[pixelIndex];
+    return 1.0f / sqrtf(
+        getPixel(cellSquaredNorms, cellCount, x, y) +
+        getPixel(cellSquaredNorms, cellCount, x + 1, y) +
+        getPixel(cellSquaredNorms, cellCount, x, y + 1) +
+        getPixel(cellSquaredNorms, cellCount, x + 1, y + 1) +
+        1e-7f);
 }
 
 inline void calculateBinWeights(
@@ -45,12 +42,27 @@ inline void calculateBinWeights(
     interpBins[1] %= binCount;
 }
 
-constexpr const int HogSettings::wgSize_[2];
-constexpr const float HogSettings::truncation_;
+// Sensitive bin of a gradient from the table of atan(t), t in [0, 1], in bins: the octant is
+// folded back from the signs and the larger component like in calcAngle (hogsimdkernels.h)
+inline float lookUpBin(
+    const float *binLut, int binLutSize, int binCount,
+    float gradientX, float gradientY)
+{
+    float absX = fabsf(gradientX);
+    float absY = fabsf(gradientY);
+    float maxXY = std::max(absX, absY);
+    float t = maxXY > 0.0f ? std::min(absX, absY) / maxXY * (float)binLutSize : 0.0f;
+    int i = std::min((int)t, binLutSize - 1);
+    float bin = binLut[i] + (t - (float)i) * (binLut[i + 1] - binLut[i]);
+    bin = absX < absY ? (float)binCount * 0.25f - bin : bin;
+    bin = gradientX < 0.0f ? (float)binCount * 0.5f - bin : bin;
+    return gradientY < 0.0f ? (float)binCount - bin : bin;
+}
 
 bool HogSettings::init(int imWidth, int imHeight)
 {
-    if (!cellSize_ || imWidth % cellSize_ || imHeight % cellSize_)
+    if (cellSize_ <= 0 || cellSize_ % 2 || insensitiveBinCount_ <= 0 ||
+        imWidth % cellSize_ || imHeight % cellSize_)
     {
         return false;
     }
@@ -74,15 +86,35 @@ int HogSettings::imHeight() const
     return cellCount_[1] * cellSize_;
 }
 
+int HogSettings::descriptorElementSize() const
+{
+    switch (descriptorFormat_)
+    {
+    case HogDescriptorFormat::float16:
+        return 2;
+    case HogDescriptorFormat::uint8:
+        return 1;
+    default:
+        return sizeof(float);
+    }
+}
+
+float HogSettings::maxDescriptorValue() const
+{
+    // The expression of DESC_MAX in hog.cl
+    return std::max(2.0f * truncation_, 0.2357f * insensitiveBinCount_ * truncation_);
+}
+
 HogProto::~HogProto()
 {
     release();
 }
 
-void HogProto::initialize(const HogSettings &settings)
+void HogProto::initialize(const HogSettings &settings, ThreadPool *threadPool)
 {
     release();
     settings_ = settings;
+    threadPool_ = threadPool;
     int cellCount = settings.cellCount_[0] * settings.cellCount_[1];
     cellSquaredNorms_ = new float [cellCount];
     std::fill(cellSquaredNorms_, cellSquaredNorms_ + cellCount, 0.0f);
@@ -99,6 +131,11 @@ void HogProto::initialize(const HogSettings &settings)
     cellInterpWeights_ = new float [weightsCount];
     std::fill(cellInterpWeights_, cellInterpWeights_ + weightsCount, 0.0f);
     calculateCellInterpolationWeights();
+    if (settings.fastBinning_)
+    {
+        binLut_ = new float [settings.binLutSize_ + 1];
+        calculateBinLut();
+    }
 }
 
 void HogProto::release()
@@ -128,13 +165,122 @@ void HogProto::release()
         delete [] cellInterpWeights_;
         cellInterpWeights_ = nullptr;
     }
+    if (binLut_)
+    {
+        delete [] binLut_;
+        binLut_ = nullptr;
+    }
+    threadPool_ = nullptr;
+    hasWindow_ = false;
 }
 
 void HogProto::calculate(const float *image)
 {
-    calculateCellDescriptor(image);
-    calculateInsensitiveNorms();
-    applyNormalization();
+    hasWindow_ = false;
+    calculateWindow(image, settings_.imWidth());
+}
+
+void HogProto::calculate(
+    const float *frame, int frameStride, const int windowCell[2],
+    bool frameUnchanged)
+{
+    int cellSize = settings_.cellSize_;
+    int cellCount[2] = { settings_.cellCount_[0], settings_.cellCount_[1] };
+    const float *image = frame + (windowCell[1] * frameStride + windowCell[0]) * cellSize;
+    int shift[2] = { windowCell[0] - windowCell_[0], windowCell[1] - windowCell_[1] };
+    // The cells of columns [reused[0], reused[2]) and rows [reused[1], reused[3]) are inside
+    // both windows and on the border of neither
+    int reused[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 2; ++i)
+    {
+        reused[i] = std::max(1, 1 - shift[i]);
+        reused[i + 2] = std::min(cellCount[i] - 1, cellCount[i] - 1 - shift[i]);
+    }
+    bool reuse = frameUnchanged && hasWindow_ && reused[0] < reused[2] && reused[1] < reused[3];
+    hasWindow_ = true;
+    windowCell_[0] = windowCell[0];
+    windowCell_[1] = windowCell[1];
+    if (!reuse)
+    {
+        calculateWindow(image, frameStride);
+        return;
+    }
+
+    shiftCells(shift, reused[1], reused[3], reused[0], reused[2]);
+    // The other cells: the rows above and below the reused ones and the columns on their sides
+    const int exposed[4][4] = {
+        { 0, reused[1], 0, cellCount[0] },
+        { reused[3], cellCount[1], 0, cellCount[0] },
+        { reused[1], reused[3], 0, reused[0] },
+        { reused[1], reused[3], reused[2], cellCount[0] } };
+    for (const int *cells : exposed)
+    {
+        if (cells[0] < cells[1] && cells[2] < cells[3])
+        {
+            calculateCellDescriptor(image, frameStride, cells[0], cells[1], cells[2], cells[3]);
+            calculateInsensitiveNorms(cells[0], cells[1], cells[2], cells[3]);
+        }
+    }
+    // The block norms of a cell read its eight neighbours, so one reused cell more around them
+    const int halo[4][4] = {
+        { 0, reused[1] + 1, 0, cellCount[0] },
+        { reused[3] - 1, cellCount[1], 0, cellCount[0] },
+        { reused[1] + 1, reused[3] - 1, 0, reused[0] + 1 },
+        { reused[1] + 1, reused[3] - 1, reused[2] - 1, cellCount[0] } };
+    for (const int *cells : halo)
+    {
+        calculateBlockInverseNorms(cells[0], cells[1], cells[2], cells[3]);
+        applyNormalization(cells[0], cells[1], cells[2], cells[3]);
+    }
+}
+
+void HogProto::calculateWindow(const float *image, int imageStride)
+{
+    int rowCount = settings_.cellCount_[1];
+    int colCount = settings_.cellCount_[0];
+    if (!threadPool_)
+    {
+        calculateCellDescriptor(image, imageStride, 0, rowCount, 0, colCount);
+        calculateInsensitiveNorms(0, rowCount, 0, colCount);
+        calculateBlockInverseNorms(0, rowCount, 0, colCount);
+        applyNormalization(0, rowCount, 0, colCount);
+        return;
+    }
+    // The blocks of a band need the squared norms of the neighbouring bands
+    int threadCount = threadPool_->threadCount();
+    threadPool_->run([&](const int thread)
+    {
+        int rowBegin = rowCount * thread / threadCount;
+        int rowEnd = rowCount * (thread + 1) / threadCount;
+        calculateCellDescriptor(image, imageStride, rowBegin, rowEnd, 0, colCount);
+        calculateInsensitiveNorms(rowBegin, rowEnd, 0, colCount);
+    });
+    threadPool_->run([&](const int thread)
+    {
+        int rowBegin = rowCount * thread / threadCount;
+        int rowEnd = rowCount * (thread + 1) / threadCount;
+        calculateBlockInverseNorms(rowBegin, rowEnd, 0, colCount);
+        applyNormalization(rowBegin, rowEnd, 0, colCount);
+    });
+}
+
+void HogProto::shiftCells(const int shift[2], int rowBegin, int rowEnd, int colBegin, int colEnd)
+{
+    int cellCountX = settings_.cellCount_[0];
+    float *buffers[4] = {
+        cellDescriptor_, cellSquaredNorms_, blockInverseNorms_, blockDescriptor_ };
+    const int cellLengths[4] = { settings_.channelsPerCell(), 1, 4, settings_.channelsPerBlock() };
+    // In the order that reads every row before it is overwritten
+    for (int i = 0; i < rowEnd - rowBegin; ++i)
+    {
+        int y = shift[1] > 0 ? rowBegin + i : rowEnd - 1 - i;
+        for (int b = 0; b < 4; ++b)
+        {
+            float *cells = buffers[b] + (y * cellCountX + colBegin) * cellLengths[b];
+            const float *sourceCells = cells + (shift[1] * cellCountX + shift[0]) * cellLengths[b];
+            memmove(cells, sourceCells, (colEnd - colBegin) * cellLengths[b] * sizeof(float));
+        }
+    }
 }
 
 void HogProto::calculateCellInterpolationWeights()
@@ -148,146 +294,212 @@ void HogProto::calculateCellInterpolationWeights()
     }
 }
 
-void HogProto::calculateCellDescriptor(const float *image)
+void HogProto::calculateBinLut()
+{
+    // The values of binLut in hog.cl, in bins instead of turns
+    for (int i = 0; i <= settings_.binLutSize_; ++i)
+    {
+        double angle = atan((double)i / settings_.binLutSize_);
+        binLut_[i] = (float)(angle * settings_.sensitiveBinCount() * 0.5 / M_PI);
+    }
+}
+
+void HogProto::calculateCellDescriptor(
+    const float *image, int imageStride,
+    int rowBegin, int rowEnd, int colBegin, int colEnd)
 {
     int cellSize = settings_.cellSize_;
     int channelsPerCell = settings_.channelsPerCell();
     int sensitiveBinCount = settings_.sensitiveBinCount();
-    int insensitiveBinCount = settings_.insensitiveBinCount_;
     int cellCount[2] = { settings_.cellCount_[0], settings_.cellCount_[1] };
     int imageSize[2] = { settings_.imWidth(), settings_.imHeight() };
-    int cellDescriptorLength = cellCount[0] * cellCount[1] * channelsPerCell;
-    std::fill(cellDescriptor_, cellDescriptor_ + cellDescriptorLength, 0.0f);
+    int cellRowLength = cellCount[0] * channelsPerCell;
+    for (int y = rowBegin; y < rowEnd; ++y)
+    {
+        std::fill(cellDescriptor_ + y * cellRowLength + colBegin * channelsPerCell,
+            cellDescriptor_ + y * cellRowLength + colEnd * channelsPerCell, 0.0f);
+    }
 
-    for (int cellY = 0; cellY < cellCount[1]; ++cellY)
+    // Every pixel lies in the 2 * cellSize neighbourhoods of two cells per axis: at
+    // cellNeighbor in cell (pixel + cellSize / 2) / cellSize and at cellNeighbor + cellSize in
+    // the previous one. Its gradient is computed once and splatted into these four cells.
+    // Pixels outside the image have no gradient, so only the ones inside are visited, from
+    // half a cell above and left of the cells to half a cell below and right of them.
+    int pixelYBegin = std::max(rowBegin * cellSize - cellSize / 2, 0);
+    int pixelYEnd = std::min(rowEnd * cellSize + cellSize - cellSize / 2, imageSize[1]);
+    int pixelXBegin = std::max(colBegin * cellSize - cellSize / 2, 0);
+    int pixelXEnd = std::min(colEnd * cellSize + cellSize - cellSize / 2, imageSize[0]);
+    for (int pixelY = pixelYBegin; pixelY < pixelYEnd; ++pixelY)
     {
-        int leftmostPixelY = cellY * cellSize - cellSize / 2;
-        for (int cellX = 0; cellX < cellCount[0]; ++cellX)
+        // The derivatives replicate the border pixels
+        const float *row = image + pixelY * imageStride;
+        const float *rowAbove = image + std::max(pixelY - 1, 0) * imageStride;
+        const float *rowBelow = image + std::min(pixelY + 1, imageSize[1] - 1) * imageStride;
+
+        int cellY = (pixelY + cellSize / 2) / cellSize;
+        int cellNeighborY = pixelY + cellSize / 2 - cellY * cellSize;
+        float *cellRows[2] = {
+            cellY - 1 >= rowBegin ? cellDescriptor_ + (cellY - 1) * cellRowLength : nullptr,
+            cellY < rowEnd ? cellDescriptor_ + cellY * cellRowLength : nullptr };
+        float cellWeightsY[2] = {
+            cellInterpWeights_[cellNeighborY + cellSize], cellInterpWeights_[cellNeighborY] };
+
+        int cellX = (pixelXBegin + cellSize / 2) / cellSize;
+        int cellNeighborX = pixelXBegin + cellSize / 2 - cellX * cellSize;
+        for (int pixelX = pixelXBegin; pixelX < pixelXEnd; ++pixelX)
         {
-            int leftmostPixelX = cellX * cellSize - cellSize / 2;
-            for (int cellNeighborY = 0; cellNeighborY < 2 * cellSize; ++cellNeighborY)
+            int left = pixelX > 0 ? pixelX - 1 : 0;
+            int right = pixelX < imageSize[0] - 1 ? pixelX + 1 : pixelX;
+            float gradientX = row[right] - row[left];
+            float gradientY = rowBelow[pixelX] - rowAbove[pixelX];
+            float magnitude = sqrtf(gradientX * gradientX + gradientY * gradientY);
+
+            float bin = 0.0f;
+            if (binLut_)
+            {
+                bin = lookUpBin(binLut_, settings_.binLutSize_, sensitiveBinCount,
+                    gradientX, gradientY);
+            }
+            else
             {
-                int pixelY = leftmostPixelY + cellNeighborY;
-                for (int cellNeighborX = 0; cellNeighborX < 2 * cellSize; ++cellNeighborX)
+                float angle = atan2f(gradientY, gradientX);
+                angle += angle < 0.0f ? 2.0f * M_PI_FLOAT : 0.0f;
+                bin = (float)sensitiveBinCount * angle * 0.5f / M_PI_FLOAT;
+            }
+
+            int interpBins[2] = { 0, 0 };
+            float interpBinWeights[2] = { 0.0f, 0.0f };
+            calculateBinWeights(bin, sensitiveBinCount, interpBins, interpBinWeights);
+
+            float cellWeightsX[2] = {
+                cellInterpWeights_[cellNeighborX + cellSize], cellInterpWeights_[cellNeighborX] };
+            for (int j = 0; j < 2; ++j)
+            {
+                if (!cellRows[j])
+                {
+                    continue;
+                }
+                for (int k = 0; k < 2; ++k)
                 {
-                    int pixelX = leftmostPixelX + cellNeighborX;
-
-                    float gradientX =
-                        getPixelDerivs(image, imageSize, pixelX + 1, pixelY) -
-                        getPixelDerivs(image, imageSize, pixelX - 1, pixelY);
-                    float gradientY =
-                        getPixelDerivs(image, imageSize, pixelX, pixelY + 1) -
-                        getPixelDerivs(image, imageSize, pixelX, pixelY - 1);
-                    if (pixelX < 0 || pixelX >= imageSize[0] ||
-                        pixelY < 0 || pixelY >= imageSize[1])
+                    int neighborX = cellX - 1 + k;
+                    if (neighborX < colBegin || neighborX >= colEnd)
                     {
-                        gradientX = gradientY = 0.0f;
+                        continue;
                     }
-                    float magnitude = sqrtf(gradientX * gradientX + gradientY * gradientY);
-
-                    float angle = atan2f(gradientY, gradientX);
-                    angle += angle < 0.0f ? 2.0f * M_PI_FLOAT : 0.0f;
-                    float bin = (float)sensitiveBinCount * angle * 0.5f / M_PI_FLOAT;
-
-                    int interpBins[2] = { 0, 0 };
-                    float interpBinWeights[2] = { 0.0f, 0.0f };
-                    calculateBinWeights(bin, sensitiveBinCount, interpBins, interpBinWeights);
-
+                    float *cell = cellRows[j] + neighborX * channelsPerCell;
                     for (int i = 0; i < 2; ++i)
                     {
-                        int channel = (cellX + cellY * cellCount[0]) * channelsPerCell + interpBins[i];
-                        cellDescriptor_[channel] += magnitude * interpBinWeights[i] *
-                            cellInterpWeights_[cellNeighborX] * cellInterpWeights_[cellNeighborY];
+                        cell[interpBins[i]] += magnitude * interpBinWeights[i] *
+                            cellWeightsX[k] * cellWeightsY[j];
                     }
                 }
             }
+            if (++cellNeighborX == cellSize)
+            {
+                cellNeighborX = 0;
+                ++cellX;
+            }
         }
     }
 
-    int cellCountTotal = cellCount[0] * cellCount[1];
-    for (int c = 0; c < cellCountTotal; ++c)
+    calculateInsensitiveDescriptor(rowBegin, rowEnd, colBegin, colEnd);
+}
+
+void HogProto::calculateInsensitiveDescriptor(int rowBegin, int rowEnd, int colBegin, int colEnd)
+{
+    int channelsPerCell = settings_.channelsPerCell();
+    int sensitiveBinCount = settings_.sensitiveBinCount();
+    int insensitiveBinCount = settings_.insensitiveBinCount_;
+    int cellCountX = settings_.cellCount_[0];
+    for (int y = rowBegin; y < rowEnd; ++y)
     {
-        int cellShift = c * channelsPerCell;
-        for (int b = 0; b < insensitiveBinCount; ++b)
+        for (int c = y * cellCountX + colBegin; c < y * cellCountX + colEnd; ++c)
         {
-            cellDescriptor_[cellShift + sensitiveBinCount + b] =
-                cellDescriptor_[cellShift + b] +
-                cellDescriptor_[cellShift + insensitiveBinCount + b];
+            int cellShift = c * channelsPerCell;
+            for (int b = 0; b < insensitiveBinCount; ++b)
+            {
+                cellDescriptor_[cellShift + sensitiveBinCount + b] =
+                    cellDescriptor_[cellShift + b] +
+                    cellDescriptor_[cellShift + insensitiveBinCount + b];
+            }
         }
     }
 }
 
-void HogProto::calculateInsensitiveNorms()
+void HogProto::calculateInsensitiveNorms(int rowBegin, int rowEnd, int colBegin, int colEnd)
 {
     int channelsPerCell = settings_.channelsPerCell();
     int sensitiveBinCount = settings_.sensitiveBinCount();
     int insensitiveBinCount = settings_.insensitiveBinCount_;
-    int cellCount[2] = { settings_.cellCount_[0], settings_.cellCount_[1] };
-    int cellCountTotal = cellCount[0] * cellCount[1];
+    int cellCountX = settings_.cellCount_[0];
     const float *cellDescriptor = cellDescriptor_ + sensitiveBinCount;
-    std::fill(cellSquaredNorms_, cellSquaredNorms_ + cellCountTotal, 0.0f);
-    std::fill(blockInverseNorms_, blockInverseNorms_ + cellCount[0] * cellCount[1] * 4, 0.0f);
-
-    for (int c = 0; c < cellCountTotal; ++c)
+    for (int y = rowBegin; y < rowEnd; ++y)
     {
-        for (int b = 0; b < insensitiveBinCount; ++b)
+        for (int c = y * cellCountX + colBegin; c < y * cellCountX + colEnd; ++c)
         {
-            float magnitude = cellDescriptor[c * channelsPerCell + b];
-            cellSquaredNorms_[c] += magnitude * magnitude;
+            cellSquaredNorms_[c] = 0.0f;
+            for (int b = 0; b < insensitiveBinCount; ++b)
+            {
+                float magnitude = cellDescriptor[c * channelsPerCell + b];
+                cellSquaredNorms_[c] += magnitude * magnitude;
+            }
         }
     }
-    for (int y = -1; y <= cellCount[1]; ++y)
+}
+
+// Cell (x, y) is the bottom-right, bottom-left, top-right and top-left cell of the blocks
+// starting at (x, y), (x - 1, y), (x, y - 1) and (x - 1, y - 1)
+void HogProto::calculateBlockInverseNorms(int rowBegin, int rowEnd, int colBegin, int colEnd)
+{
+    int cellCount[2] = { settings_.cellCount_[0], settings_.cellCount_[1] };
+    for (int y = rowBegin; y < rowEnd; ++y)
     {
-        for (int x = -1; x <= cellCount[0]; ++x)
+        for (int x = colBegin; x < colEnd; ++x)
         {
-            float inverseNorm = 1.0f / sqrtf(
-                getPixel(cellSquaredNorms_, cellCount, x, y) +
-                getPixel(cellSquaredNorms_, cellCount, x + 1, y) +
-                getPixel(cellSquaredNorms_, cellCount, x, y + 1) +
-                getPixel(cellSquaredNorms_, cellCount, x + 1, y + 1) +
-                1e-7f);
-            setPixel(blockInverseNorms_, inverseNorm, cellCount, 4, x, y, 0);
-            setPixel(blockInverseNorms_, inverseNorm, cellCount, 4, x + 1, y, 1);
-            setPixel(blockInverseNorms_, inverseNorm, cellCount, 4, x, y + 1, 2);
-            setPixel(blockInverseNorms_, inverseNorm, cellCount, 4, x + 1, y + 1, 3);
+            float *inverseNorms = blockInverseNorms_ + (x + y * cellCount[0]) * 4;
+            inverseNorms[0] = getBlockInverseNorm(cellSquaredNorms_, cellCount, x, y);
+            inverseNorms[1] = getBlockInverseNorm(cellSquaredNorms_, cellCount, x - 1, y);
+            inverseNorms[2] = getBlockInverseNorm(cellSquaredNorms_, cellCount, x, y - 1);
+            inverseNorms[3] = getBlockInverseNorm(cellSquaredNorms_, cellCount, x - 1, y - 1);
         }
     }
 }
 
-void HogProto::applyNormalization()
+void HogProto::applyNormalization(int rowBegin, int rowEnd, int colBegin, int colEnd)
 {
     int sensitiveBinCount = settings_.sensitiveBinCount();
     int insensitiveBinCount = settings_.insensitiveBinCount_;
     int channelsPerCell = settings_.channelsPerCell();
     int channelsPerBlock = settings_.channelsPerBlock();
-    int cellCountTotal = settings_.cellCount_[0] * settings_.cellCount_[1];
+    int cellCountX = settings_.cellCount_[0];
     float truncation = settings_.truncation_;
-    std::fill(blockDescriptor_, blockDescriptor_ + cellCountTotal * channelsPerBlock, 0.0f);
 
-    for (int c = 0; c < cellCountTotal; ++c)
+    for (int y = rowBegin; y < rowEnd; ++y)
     {
-        for (int b = 0; b < channelsPerCell; ++b)
+        for (int c = y * cellCountX + colBegin; c < y * cellCountX + colEnd; ++c)
         {
-            float unnormalized = cellDescriptor_[c * channelsPerCell + b];
-            float normalized = 0.0f;
-            for (int i = 0; i < 4; ++i)
+            for (int b = 0; b < channelsPerCell; ++b)
             {
-                normalized += 0.5f * fminf(unnormalized * blockInverseNorms_[c * 4 + i], truncation);
+                float unnormalized = cellDescriptor_[c * channelsPerCell + b];
+                float normalized = 0.0f;
+                for (int i = 0; i < 4; ++i)
+                {
+                    normalized += 0.5f * fminf(unnormalized * blockInverseNorms_[c * 4 + i],
+                        truncation);
+                }
+                blockDescriptor_[c * channelsPerBlock + b] = normalized;
             }
-            blockDescriptor_[c * channelsPerBlock + b] = normalized;
-        }
-        for (int i = 0; i < 4; ++i)
-        {
-            float normalization = blockInverseNorms_[c * 4 + i];
-            float normalized = 0.0f;
-            for (int b = 0; b < insensitiveBinCount; ++b)
+            for (int i = 0; i < 4; ++i)
             {
-                normalized +=  0.2357f * fminf(
-                    normalization * cellDescriptor_[c * channelsPerCell + sensitiveBinCount + b],
-                    truncation);
+                float normalization = blockInverseNorms_[c * 4 + i];
+                float normalized = 0.0f;
+                for (int b = 0; b < insensitiveBinCount; ++b)
+                {
+                    normalized +=  0.2357f * fminf(normalization *
+                        cellDescriptor_[c * channelsPerCell + sensitiveBinCount + b], truncation);
+                }
+                blockDescriptor_[c * channelsPerBlock + channelsPerCell + i] = normalized;
             }
-            blockDescriptor_[c * channelsPerBlock + channelsPerCell + i] = normalized;
         }
     }
 }
-
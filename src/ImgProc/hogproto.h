@@ -3,34 +3,79 @@
 
 typedef unsigned char uchar;
 
+class ThreadPool;
+
+// Element type of the block descriptors of Hog (DESC_FORMAT in hog.cl), uint8 scaled so that
+// HogSettings::maxDescriptorValue() is 255
+enum class HogDescriptorFormat : int
+{
+    float32 = 0,
+    float16,
+    uint8
+};
+
 // TODO: use these settings in Piotr's method.
+// The cell size, bin count, truncation and work-group size are set before init; Hog gets
+// them as -D options of hog.cl through HogProgramCache.
 struct HogSettings
 {
     bool init(int imWidth, int imHeight);
 
-    static int sensitiveBinCount() { return insensitiveBinCount_ * 2; }
-    static int channelsPerCell() { return insensitiveBinCount_ + sensitiveBinCount(); }
-    static int channelsPerBlock() { return channelsPerCell() + 4; }
+    int sensitiveBinCount() const { return insensitiveBinCount_ * 2; }
+    int channelsPerCell() const { return insensitiveBinCount_ + sensitiveBinCount(); }
+    int channelsPerBlock() const { return channelsPerCell() + 4; }
 
     int descLen() const;
     int imWidth() const;
     int imHeight() const;
+    // Of descriptorFormat_, in bytes
+    int descriptorElementSize() const;
+    // Of a channel of the block descriptor: a bin truncated in its 4 blocks or a texture
+    // channel of insensitive bins that are all truncated
+    float maxDescriptorValue() const;
 
-    static const int insensitiveBinCount_ = 9;
-    static const int cellSize_ = 4;
-    static constexpr const int wgSize_[2] = { 16, 16 };
-    static constexpr const float truncation_ = 0.2f;
+    int insensitiveBinCount_ = 9;
+    // Even, the cells being split at their centres
+    int cellSize_ = 4;
+    // Hog only: square and a multiple of cellSize_
+    int wgSize_[2] = { 16, 16 };
+    float truncation_ = 0.2f;
+    // Intervals of the orientation table over [0, 1] (BIN_LUT_SZ in hog.cl)
+    static const int binLutSize_ = 32;
 
     int cellCount_[2] = { 0, 0 };
+    // Orientation bins interpolated from a table of atan over one octant instead of atan2,
+    // in HogProto and Hog (HogSimd evaluates a polynomial either way)
+    bool fastBinning_ = false;
+    // Hog only: two kernel launches instead of four, the cell norms coming out of calcCellDesc
+    // and the inverse block norms computed inside the normalization
+    bool fusedKernels_ = false;
+    // Hog only: BlockHog::descriptor_ in half floats or bytes to read back less, turned back
+    // into floats by BlockHog::unpackDescriptor
+    HogDescriptorFormat descriptorFormat_ = HogDescriptorFormat::float32;
 };
 
+// With a thread pool every stage is split into bands of cell rows, one per pool thread. A band
+// reads the pixels half a cell beyond its rows (the bilinear spatial interpolation) and the
+// squared norms of the cell rows next to it (the 2x2 blocks), so the norms of all the bands
+// are complete before any block is normalized. Every value is computed by the same
+// expression as in the serial path, which makes both paths bit-identical. The pool is not
+// owned, must outlive the HogProto and keep its thread count.
 class HogProto
 {
 public:
     ~HogProto();
-    void initialize(const HogSettings &settings);
+    void initialize(const HogSettings &settings, ThreadPool *threadPool = nullptr);
     void release();
     void calculate(const float *image);
+    // The window of settings_ sizes whose top-left cell is windowCell in a frame of
+    // frameStride pixels per row, computed as if the window were the whole image. With
+    // frameUnchanged the frame is the one of the previous call: the cell histograms of the
+    // previous window are reused by absolute cell, apart from its border cells (they see the
+    // border replication), and only the newly exposed cells and their normalization halo are
+    // recomputed, serially. Otherwise the whole window is computed like calculate.
+    void calculate(const float *frame, int frameStride, const int windowCell[2],
+        bool frameUnchanged);
 
     HogSettings settings_;
     float *cellSquaredNorms_ = nullptr;
@@ -38,12 +83,28 @@ public:
     float *cellDescriptor_ = nullptr;
     float *blockDescriptor_ = nullptr;
     float *cellInterpWeights_ = nullptr;
+    float *binLut_ = nullptr;
 
 protected:
     void calculateCellInterpolationWeights();
-    void calculateCellDescriptor(const float *image);
-    void calculateInsensitiveNorms();
-    void applyNormalization();
+    void calculateBinLut();
+    void calculateWindow(const float *image, int imageStride);
+    // Cell (x, y) of rows [rowBegin, rowEnd) and columns [colBegin, colEnd) takes all the values
+    // of cell (x + shift[0], y + shift[1])
+    void shiftCells(const int shift[2], int rowBegin, int rowEnd, int colBegin, int colEnd);
+    // Each stage covers the cells of rows [rowBegin, rowEnd) and columns [colBegin, colEnd)
+    void calculateCellDescriptor(const float *image, int imageStride,
+        int rowBegin, int rowEnd, int colBegin, int colEnd);
+    // Folds the sensitive bins of opposite directions into the insensitive ones
+    void calculateInsensitiveDescriptor(int rowBegin, int rowEnd, int colBegin, int colEnd);
+    void calculateInsensitiveNorms(int rowBegin, int rowEnd, int colBegin, int colEnd);
+    void calculateBlockInverseNorms(int rowBegin, int rowEnd, int colBegin, int colEnd);
+    void applyNormalization(int rowBegin, int rowEnd, int colBegin, int colEnd);
+
+    ThreadPool *threadPool_ = nullptr;
+    // Top-left cell in the frame of the last window, valid after the windowed calculate only
+    bool hasWindow_ = false;
+    int windowCell_[2] = { 0, 0 };
 };
 
 #endif // HOGPROTO_H
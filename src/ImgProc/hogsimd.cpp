@@ -0,0 +1,181 @@
+#include <hogsimd.h>
+#include <algorithm>
+#include <threadpool.h>
+#include <hogsimdkernels.h>
+
+HogSimd::~HogSimd()
+{
+    release();
+}
+
+void HogSimd::initialize(const HogSettings &settings, ThreadPool *threadPool, int maxLaneCount)
+{
+    release();
+    HogProto::initialize(settings, threadPool);
+    __builtin_cpu_init();
+    laneCount_ = maxLaneCount >= 8 && __builtin_cpu_supports("avx2") ? 8 : 4;
+
+    int cellSize = settings_.cellSize_;
+    int width = settings_.imWidth();
+    columnCells_ = new int [2 * width];
+    columnWeights_ = new float [2 * width];
+    for (int x = 0; x < width; ++x)
+    {
+        int cellX = (x + cellSize / 2) / cellSize;
+        int cellNeighborX = x + cellSize / 2 - cellX * cellSize;
+        columnCells_[2 * x] = std::max(cellX - 1, 0);
+        columnCells_[2 * x + 1] = std::min(cellX, settings_.cellCount_[0] - 1);
+        columnWeights_[2 * x] = cellX > 0 ? cellInterpWeights_[cellNeighborX + cellSize] : 0.0f;
+        columnWeights_[2 * x + 1] =
+            cellX < settings_.cellCount_[0] ? cellInterpWeights_[cellNeighborX] : 0.0f;
+    }
+    int threadCount = threadPool_ ? threadPool_->threadCount() : 1;
+    rowBins_ = new int [threadCount * 2 * width];
+    std::fill(rowBins_, rowBins_ + threadCount * 2 * width, 0);
+    rowMagnitudes_ = new float [threadCount * 2 * width];
+    std::fill(rowMagnitudes_, rowMagnitudes_ + threadCount * 2 * width, 0.0f);
+}
+
+void HogSimd::release()
+{
+    if (columnCells_)
+    {
+        delete [] columnCells_;
+        columnCells_ = nullptr;
+    }
+    if (columnWeights_)
+    {
+        delete [] columnWeights_;
+        columnWeights_ = nullptr;
+    }
+    if (rowBins_)
+    {
+        delete [] rowBins_;
+        rowBins_ = nullptr;
+    }
+    if (rowMagnitudes_)
+    {
+        delete [] rowMagnitudes_;
+        rowMagnitudes_ = nullptr;
+    }
+    laneCount_ = 0;
+    HogProto::release();
+}
+
+void HogSimd::calculate(const float *image)
+{
+    int rowCount = settings_.cellCount_[1];
+    int colCount = settings_.cellCount_[0];
+    if (!threadPool_)
+    {
+        calculateCellDescriptor(image, 0, rowCount, 0);
+        calculateInsensitiveNorms(0, rowCount, 0, colCount);
+        calculateBlockInverseNorms(0, rowCount, 0, colCount);
+        applyNormalization(0, rowCount);
+        return;
+    }
+    // The blocks of a band need the squared norms of the neighbouring bands
+    int threadCount = threadPool_->threadCount();
+    threadPool_->run([&](const int thread)
+    {
+        int rowBegin = rowCount * thread / threadCount;
+        int rowEnd = rowCount * (thread + 1) / threadCount;
+        calculateCellDescriptor(image, rowBegin, rowEnd, thread);
+        calculateInsensitiveNorms(rowBegin, rowEnd, 0, colCount);
+    });
+    threadPool_->run([&](const int thread)
+    {
+        int rowBegin = rowCount * thread / threadCount;
+        int rowEnd = rowCount * (thread + 1) / threadCount;
+        calculateBlockInverseNorms(rowBegin, rowEnd, 0, colCount);
+        applyNormalization(rowBegin, rowEnd);
+    });
+}
+
+// The pixel rows and the cells they are splatted into are the ones of
+// HogProto::calculateCellDescriptor. Only the orientations are vectorised, the scatter stays
+// scalar with the cells outside the image replaced by a clamped cell and a zero weight.
+void HogSimd::calculateCellDescriptor(const float *image, int rowBegin, int rowEnd, int thread)
+{
+    int cellSize = settings_.cellSize_;
+    int channelsPerCell = settings_.channelsPerCell();
+    int sensitiveBinCount = settings_.sensitiveBinCount();
+    int imageSize[2] = { settings_.imWidth(), settings_.imHeight() };
+    int cellRowLength = settings_.cellCount_[0] * channelsPerCell;
+    std::fill(cellDescriptor_ + rowBegin * cellRowLength,
+        cellDescriptor_ + rowEnd * cellRowLength, 0.0f);
+
+    int *bins[2] = { rowBins_ + 2 * thread * imageSize[0], nullptr };
+    bins[1] = bins[0] + imageSize[0];
+    float *magnitudes[2] = { rowMagnitudes_ + 2 * thread * imageSize[0], nullptr };
+    magnitudes[1] = magnitudes[0] + imageSize[0];
+
+    int pixelYBegin = std::max(rowBegin * cellSize - cellSize / 2, 0);
+    int pixelYEnd = std::min(rowEnd * cellSize + cellSize - cellSize / 2, imageSize[1]);
+    for (int pixelY = pixelYBegin; pixelY < pixelYEnd; ++pixelY)
+    {
+        const float *row = image + pixelY * imageSize[0];
+        const float *rowAbove = image + std::max(pixelY - 1, 0) * imageSize[0];
+        const float *rowBelow = image + std::min(pixelY + 1, imageSize[1] - 1) * imageSize[0];
+        if (laneCount_ == 8)
+        {
+            calcRowBinsAvx2(row, rowAbove, rowBelow, imageSize[0], sensitiveBinCount, bins,
+                magnitudes);
+        }
+        else
+        {
+            calcRowBins<FloatX4, 4>(row, rowAbove, rowBelow, imageSize[0], sensitiveBinCount,
+                bins, magnitudes);
+        }
+
+        int cellY = (pixelY + cellSize / 2) / cellSize;
+        int cellNeighborY = pixelY + cellSize / 2 - cellY * cellSize;
+        for (int j = 0; j < 2; ++j)
+        {
+            int neighborY = cellY - 1 + j;
+            if (neighborY < rowBegin || neighborY >= rowEnd)
+            {
+                continue;
+            }
+            float *cellRow = cellDescriptor_ + neighborY * cellRowLength;
+            float cellWeightY = cellInterpWeights_[cellNeighborY + (1 - j) * cellSize];
+            for (int pixelX = 0; pixelX < imageSize[0]; ++pixelX)
+            {
+                for (int k = 0; k < 2; ++k)
+                {
+                    float *cell = cellRow + columnCells_[2 * pixelX + k] * channelsPerCell;
+                    float cellWeightX = columnWeights_[2 * pixelX + k];
+                    cell[bins[0][pixelX]] += magnitudes[0][pixelX] * cellWeightX * cellWeightY;
+                    cell[bins[1][pixelX]] += magnitudes[1][pixelX] * cellWeightX * cellWeightY;
+                }
+            }
+        }
+    }
+
+    calculateInsensitiveDescriptor(rowBegin, rowEnd, 0, settings_.cellCount_[0]);
+}
+
+void HogSimd::applyNormalization(int rowBegin, int rowEnd)
+{
+    int channelsPerCell = settings_.channelsPerCell();
+    int channelsPerBlock = settings_.channelsPerBlock();
+    int sensitiveBinCount = settings_.sensitiveBinCount();
+    int insensitiveBinCount = settings_.insensitiveBinCount_;
+    float truncation = settings_.truncation_;
+    for (int c = rowBegin * settings_.cellCount_[0]; c < rowEnd * settings_.cellCount_[0]; ++c)
+    {
+        const float *cellDescriptor = cellDescriptor_ + c * channelsPerCell;
+        const float *inverseNorms = blockInverseNorms_ + c * 4;
+        float *blockDescriptor = blockDescriptor_ + c * channelsPerBlock;
+        if (laneCount_ == 8)
+        {
+            normalizeCellAvx2(cellDescriptor, inverseNorms, channelsPerCell, sensitiveBinCount,
+                insensitiveBinCount, truncation, blockDescriptor);
+        }
+        else
+        {
+            normalizeCell<FloatX4, 4>(cellDescriptor, inverseNorms, channelsPerCell,
+                sensitiveBinCount, insensitiveBinCount, truncation, blockDescriptor);
+        }
+    }
+}
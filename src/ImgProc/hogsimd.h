@@ -0,0 +1,44 @@
+#ifndef HOGSIMD_H
+#define HOGSIMD_H
+
+#include <hogproto.h>
+
+// Vectorised CPU HOG for hosts without a usable OpenCL device: the same HogSettings and the
+// same output as Hog, blockDescriptor_ holding channelsPerBlock() floats per cell, cell-major
+// like BlockHog::descriptor_. The orientations of a pixel row are computed 8 (AVX2, chosen at
+// runtime) or 4 (SSE) pixels at a time with a polynomial atan2, then every pixel is splatted
+// into its four cells like in HogProto; the normalization runs over the channels of a cell.
+// Apart from the atan2 approximation every value is computed by the same expression as in
+// HogProto, the bands of cell rows over the thread pool included. The HogProto base is
+// private: its initialize and calculate (the windowed one included) would bypass the buffers
+// sized here, so only the calls below are exported.
+class HogSimd : private HogProto
+{
+public:
+    ~HogSimd();
+    void initialize(
+        const HogSettings &settings,
+        ThreadPool *threadPool = nullptr,
+        int maxLaneCount = 8);
+    void release();
+    void calculate(const float *image);
+    int laneCount() const { return laneCount_; }
+
+    using HogProto::settings_;
+    using HogProto::blockDescriptor_;
+
+protected:
+    void calculateCellDescriptor(const float *image, int rowBegin, int rowEnd, int thread);
+    void applyNormalization(int rowBegin, int rowEnd);
+
+    int laneCount_ = 0;
+    // Per pixel column: the two cells whose neighbourhood contains it (clamped to the image)
+    // and their interpolation weights (zero for the cells outside the image)
+    int *columnCells_ = nullptr;
+    float *columnWeights_ = nullptr;
+    // Per pool thread: the two bins and the two weighted magnitudes of a pixel row
+    int *rowBins_ = nullptr;
+    float *rowMagnitudes_ = nullptr;
+};
+
+#endif // HOGSIMD_H
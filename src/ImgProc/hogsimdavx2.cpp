@@ -0,0 +1,52 @@
+// Everything below the pragma is compiled for AVX2 and must be called only after a runtime
+// check (see HogSimd::initialize). The standard headers are included before it, so that their
+// inline functions keep the default target. FMA is left out so that the lanes round like the
+// SSE ones.
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#include <hogsimdkernels.h>
+
+typedef float FloatX8 __attribute__((vector_size(32), __may_alias__));
+typedef int IntX8 __attribute__((vector_size(32), __may_alias__));
+
+template <>
+struct HogLanes<8>
+{
+    typedef IntX8 Int;
+    static FloatX8 sqrt(FloatX8 x) { return _mm256_sqrt_ps(x); }
+    static IntX8 toInt(FloatX8 x) { return __builtin_convertvector(x, IntX8); }
+    static FloatX8 toFloat(IntX8 x) { return __builtin_convertvector(x, FloatX8); }
+};
+
+void calcRowBinsAvx2(
+    const float *row,
+    const float *rowAbove,
+    const float *rowBelow,
+    int width,
+    int sensitiveBinCount,
+    int *bins[2],
+    float *magnitudes[2])
+{
+    calcRowBins<FloatX8, 8>(row, rowAbove, rowBelow, width, sensitiveBinCount, bins,
+        magnitudes);
+}
+
+void normalizeCellAvx2(
+    const float *cellDescriptor,
+    const float inverseNorms[4],
+    int channelsPerCell,
+    int sensitiveBinCount,
+    int insensitiveBinCount,
+    float truncation,
+    float *blockDescriptor)
+{
+    normalizeCell<FloatX8, 8>(cellDescriptor, inverseNorms, channelsPerCell, sensitiveBinCount,
+        insensitiveBinCount, truncation, blockDescriptor);
+}
+
+#pragma GCC pop_options
@@ -0,0 +1,202 @@
+#ifndef HOGSIMDKERNELS_H
+#define HOGSIMDKERNELS_H
+
+#include <cmath>
+#include <cstring>
+#include <xmmintrin.h>
+
+// Row loops of the vectorised CPU HOG (HogSimd). Like the FFT butterflies, every template is
+// written for a lane type V which is either float or a GCC vector of floats, so the same code
+// handles the border pixels one at a time and the rest 4 or 8 at a time. Translation units
+// which instantiate them with AVX vectors are compiled with the AVX2 target, so nothing but
+// templates and inline functions may live here.
+
+typedef float FloatX4 __attribute__((vector_size(16), __may_alias__));
+typedef int IntX4 __attribute__((vector_size(16), __may_alias__));
+
+// What the vector extensions do not cover, per lane count: the integer lanes, sqrt and the
+// conversions
+template <int laneCount>
+struct HogLanes;
+
+template <>
+struct HogLanes<1>
+{
+    typedef int Int;
+    static float sqrt(float x) { return sqrtf(x); }
+    static int toInt(float x) { return static_cast<int>(x); }
+    static float toFloat(int x) { return static_cast<float>(x); }
+};
+
+template <>
+struct HogLanes<4>
+{
+    typedef IntX4 Int;
+    static FloatX4 sqrt(FloatX4 x) { return _mm_sqrt_ps(x); }
+    static IntX4 toInt(FloatX4 x) { return __builtin_convertvector(x, IntX4); }
+    static FloatX4 toFloat(IntX4 x) { return __builtin_convertvector(x, FloatX4); }
+};
+
+template <typename V>
+inline V loadLanes(const float *src)
+{
+    V v;
+    memcpy(&v, src, sizeof(V));
+    return v;
+}
+
+template <typename V>
+inline void storeLanes(const V &v, void *dst)
+{
+    memcpy(dst, &v, sizeof(V));
+}
+
+// atan2 in [0, 2\pi) for the orientation bins: atan of min / max in [0, 1] (one reduction by
+// \pi / 4 and the Cephes atanf polynomial, about 1e-7 rad) and the octant from the signs and
+// the larger component
+template <typename V>
+inline V calcAngle(V gradientX, V gradientY)
+{
+    const float PI_FLOAT = 3.14159265358979f;
+    const V absX = gradientX < 0.0f ? -gradientX : gradientX;
+    const V absY = gradientY < 0.0f ? -gradientY : gradientY;
+    const V maxXY = absX < absY ? absY : absX;
+    const V minXY = absX < absY ? absX : absY;
+    // No gradient at all gives 0 rather than 0 / 0
+    V t = minXY / (maxXY < 1e-30f ? 1e-30f : maxXY);
+    const auto reduced = t > 0.41421356f;
+    t = reduced ? (t - 1.0f) / (t + 1.0f) : t;
+    const V z = t * t;
+    V angle = (((8.05374449538e-2f * z - 1.38776856032e-1f) * z + 1.99777106478e-1f) * z -
+        3.33329491539e-1f) * z * t + t;
+    angle = reduced ? angle + 0.25f * PI_FLOAT : angle;
+    angle = absX < absY ? 0.5f * PI_FLOAT - angle : angle;
+    angle = gradientX < 0.0f ? PI_FLOAT - angle : angle;
+    return gradientY < 0.0f ? 2.0f * PI_FLOAT - angle : angle;
+}
+
+// Orientation bins and magnitudes of one lane group (the pixels x..x + lanes - 1) of a row,
+// split between the two nearest bins like HogProto: the bins to bins[0 / 1][x], the magnitudes
+// weighted by the bin weights to magnitudes[0 / 1][x]
+template <typename V>
+inline void calcPixelBins(
+    V gradientX,
+    V gradientY,
+    int sensitiveBinCount,
+    int x,
+    int *bins[2],
+    float *magnitudes[2])
+{
+    typedef HogLanes<sizeof(V) / sizeof(float)> Lanes;
+    typedef typename Lanes::Int VI;
+    const float PI_FLOAT = 3.14159265358979f;
+    const V magnitude = Lanes::sqrt(gradientX * gradientX + gradientY * gradientY);
+    const V bin = (float)sensitiveBinCount * calcAngle(gradientX, gradientY) * 0.5f / PI_FLOAT;
+    VI bin0 = Lanes::toInt(bin);
+    const V weight1 = bin - Lanes::toFloat(bin0);
+    const V weight0 = 1.0f - weight1;
+    VI bin1 = bin0 + 1;
+    bin0 = bin0 >= sensitiveBinCount ? bin0 - sensitiveBinCount : bin0;
+    bin1 = bin1 >= sensitiveBinCount ? bin1 - sensitiveBinCount : bin1;
+    storeLanes(bin0, bins[0] + x);
+    storeLanes(bin1, bins[1] + x);
+    storeLanes(V(magnitude * weight0), magnitudes[0] + x);
+    storeLanes(V(magnitude * weight1), magnitudes[1] + x);
+}
+
+// Central differences of a pixel row, the border pixels being replicated; rowAbove and
+// rowBelow are row itself at the top and the bottom of the image
+template <typename V, int laneCount>
+void calcRowBins(
+    const float *row,
+    const float *rowAbove,
+    const float *rowBelow,
+    int width,
+    int sensitiveBinCount,
+    int *bins[2],
+    float *magnitudes[2])
+{
+    const int right = width > 1 ? 1 : 0;
+    calcPixelBins<float>(row[right] - row[0], rowBelow[0] - rowAbove[0], sensitiveBinCount, 0,
+        bins, magnitudes);
+    int x = 1;
+    for (; x + laneCount < width; x += laneCount)
+    {
+        const V gradientX = loadLanes<V>(row + x + 1) - loadLanes<V>(row + x - 1);
+        const V gradientY = loadLanes<V>(rowBelow + x) - loadLanes<V>(rowAbove + x);
+        calcPixelBins<V>(gradientX, gradientY, sensitiveBinCount, x, bins, magnitudes);
+    }
+    for (; x < width; ++x)
+    {
+        const int right = x < width - 1 ? x + 1 : x;
+        calcPixelBins<float>(row[right] - row[x - 1], rowBelow[x] - rowAbove[x],
+            sensitiveBinCount, x, bins, magnitudes);
+    }
+}
+
+// Normalizes one cell like HogProto::applyNormalization: channelsPerCell channels truncated
+// against each of the 4 block norms, then the 4 texture channels
+template <typename V, int laneCount>
+void normalizeCell(
+    const float *cellDescriptor,
+    const float inverseNorms[4],
+    int channelsPerCell,
+    int sensitiveBinCount,
+    int insensitiveBinCount,
+    float truncation,
+    float *blockDescriptor)
+{
+    int b = 0;
+    for (; b + laneCount <= channelsPerCell; b += laneCount)
+    {
+        const V unnormalized = loadLanes<V>(cellDescriptor + b);
+        V normalized = V();
+        for (int i = 0; i < 4; ++i)
+        {
+            const V scaled = unnormalized * inverseNorms[i];
+            normalized += 0.5f * (scaled < truncation ? scaled : truncation);
+        }
+        storeLanes(normalized, blockDescriptor + b);
+    }
+    for (; b < channelsPerCell; ++b)
+    {
+        float normalized = 0.0f;
+        for (int i = 0; i < 4; ++i)
+        {
+            const float scaled = cellDescriptor[b] * inverseNorms[i];
+            normalized += 0.5f * (scaled < truncation ? scaled : truncation);
+        }
+        blockDescriptor[b] = normalized;
+    }
+
+    // The 4 block norms in the lanes of one SSE vector
+    const FloatX4 norms = loadLanes<FloatX4>(inverseNorms);
+    FloatX4 texture = FloatX4();
+    for (int i = 0; i < insensitiveBinCount; ++i)
+    {
+        const FloatX4 scaled = norms * cellDescriptor[sensitiveBinCount + i];
+        texture += 0.2357f * (scaled < truncation ? scaled : truncation);
+    }
+    storeLanes(texture, blockDescriptor + channelsPerCell);
+}
+
+// Defined in hogsimdavx2.cpp, which is compiled for the AVX2 target
+void calcRowBinsAvx2(
+    const float *row,
+    const float *rowAbove,
+    const float *rowBelow,
+    int width,
+    int sensitiveBinCount,
+    int *bins[2],
+    float *magnitudes[2]);
+
+void normalizeCellAvx2(
+    const float *cellDescriptor,
+    const float inverseNorms[4],
+    int channelsPerCell,
+    int sensitiveBinCount,
+    int insensitiveBinCount,
+    float truncation,
+    float *blockDescriptor);
+
+#endif // HOGSIMDKERNELS_H
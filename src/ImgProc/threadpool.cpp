@@ -0,0 +1,87 @@
+#include <threadpool.h>
+
+ThreadPool::~ThreadPool()
+{
+    release();
+}
+
+bool ThreadPool::init(const int threadCount)
+{
+    release();
+    if (threadCount < 1)
+    {
+        return false;
+    }
+    threadCount_ = threadCount;
+    workers_.reserve(threadCount_ - 1);
+    for (int i = 1; i < threadCount_; ++i)
+    {
+        workers_.emplace_back(&ThreadPool::work, this, i);
+    }
+    return true;
+}
+
+void ThreadPool::release()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    started_.notify_all();
+    for (std::thread &worker : workers_)
+    {
+        worker.join();
+    }
+    workers_.clear();
+    // The next workers start from generation 0
+    task_ = nullptr;
+    generation_ = 0U;
+    pendingCount_ = 0;
+    stopping_ = false;
+    threadCount_ = 0;
+}
+
+void ThreadPool::run(const std::function<void(int)> &task)
+{
+    if (workers_.empty())
+    {
+        task(0);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        pendingCount_ = static_cast<int>(workers_.size());
+        ++generation_;
+    }
+    started_.notify_all();
+    task(0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    finished_.wait(lock, [this]() { return pendingCount_ == 0; });
+    task_ = nullptr;
+}
+
+void ThreadPool::work(const int index)
+{
+    unsigned int generation = 0U;
+    for (;;)
+    {
+        const std::function<void(int)> *task = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            started_.wait(lock, [&]() { return stopping_ || generation_ != generation; });
+            if (stopping_)
+            {
+                return;
+            }
+            generation = generation_;
+            task = task_;
+        }
+        (*task)(index);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pendingCount_ == 0)
+        {
+            finished_.notify_one();
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads started once by init and parked between calls, so running a
+// parallel loop costs a wake-up instead of a thread creation. The calling thread takes part
+// in every run as thread 0.
+class ThreadPool
+{
+public:
+    ~ThreadPool();
+    bool init(const int threadCount);
+    void release();
+    // Calls task(i) for i = 0..threadCount() - 1 concurrently and returns when all calls have
+    // finished. Not reentrant: one run at a time per pool.
+    void run(const std::function<void(int)> &task);
+    int threadCount() const { return threadCount_; }
+
+protected:
+    void work(const int index);
+
+    int threadCount_ = 0;
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable started_;
+    std::condition_variable finished_;
+    const std::function<void(int)> *task_ = nullptr;
+    unsigned int generation_ = 0U;
+    int pendingCount_ = 0;
+    bool stopping_ = false;
+};
+
+#endif // THREADPOOL_H
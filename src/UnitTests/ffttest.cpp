@@ -1,6 +1,18 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
 #include <gtest/gtest.h>
 #include <opencv2/opencv.hpp>
+#include <fft.h>
+#include <fftcorrelationproto.h>
 #include <fftproto.h>
+#include <fftwisdom.h>
+#include <hog.h>
+#include <oclprocessor.h>
+#include <threadpool.h>
 #include <testhelpers.h>
 
 std::vector<float> generateRandomData(const uint N)
@@ -26,6 +38,322 @@ std::vector<float> generateRandomData(const std::vector<uint> &stages)
     return generateRandomData(N);
 }
 
+class FftTestProcessor : public OclProcessor
+{
+public:
+    FftTestProcessor()
+    {
+        kernelPaths_ = { "fft.cl" };
+    }
+
+    ~FftTestProcessor()
+    {
+        release();
+    }
+
+    bool setup(int width, int height, FftPasses passes, bool inverse)
+    {
+        if (!setupBuffers(width * height * sizeof(cl_float2), width * height * sizeof(cl_float2)))
+        {
+            return false;
+        }
+        return fft_.initialize(width, height, passes, inverse, oclContext_, oclProgram_,
+            oclSrc_) == CL_SUCCESS;
+    }
+
+    // src holds cellStride floats per cell, dst channelCount complex values per cell
+    bool setupRealChannels(
+        int width,
+        int height,
+        int channelCount,
+        int cellStride,
+        FftPasses passes)
+    {
+        if (!setupBuffers(width * height * cellStride * sizeof(cl_float),
+                width * height * channelCount * sizeof(cl_float2)))
+        {
+            return false;
+        }
+        return fft_.initializeRealChannels(width, height, channelCount, cellStride, passes,
+            oclContext_, oclProgram_, oclSrc_) == CL_SUCCESS;
+    }
+
+    bool processFrame(const float *src, float *dst)
+    {
+        cl_event writeEvent = NULL;
+        cl_int status = clEnqueueWriteBuffer(oclQueue_, oclSrc_, CL_FALSE, 0,
+            srcSzInBytes_, src, 0, NULL, &writeEvent);
+        cl_event fftEvent = NULL;
+        if (status == CL_SUCCESS)
+        {
+            status = fft_.calculate(oclQueue_, 1, &writeEvent, fftEvent);
+        }
+        if (writeEvent)
+        {
+            clReleaseEvent(writeEvent);
+            writeEvent = NULL;
+        }
+        if (status == CL_SUCCESS)
+        {
+            status = clEnqueueReadBuffer(oclQueue_, fft_.transformed_, CL_TRUE, 0,
+                dstSzInBytes_, dst, 1, &fftEvent, NULL);
+        }
+        if (fftEvent)
+        {
+            clReleaseEvent(fftEvent);
+            fftEvent = NULL;
+        }
+        return status == CL_SUCCESS;
+    }
+
+protected:
+    bool setupBuffers(size_t srcSzInBytes, size_t dstSzInBytes)
+    {
+        release();
+        if (OclProcessor::initialize() != CL_SUCCESS)
+        {
+            return false;
+        }
+        srcSzInBytes_ = srcSzInBytes;
+        dstSzInBytes_ = dstSzInBytes;
+        oclSrc_ = clCreateBuffer(oclContext_, CL_MEM_READ_ONLY, srcSzInBytes_, NULL, NULL);
+        return oclSrc_ != NULL;
+    }
+
+    void release()
+    {
+        fft_.release();
+        if (oclSrc_)
+        {
+            clReleaseMemObject(oclSrc_);
+            oclSrc_ = NULL;
+        }
+        OclProcessor::release();
+    }
+
+    size_t srcSzInBytes_ = 0;
+    size_t dstSzInBytes_ = 0;
+    cl_mem oclSrc_ = NULL;
+    Fft fft_;
+};
+
+float maxAbs(const std::vector<float> &x)
+{
+    float m = 0.0f;
+    for (const float v : x)
+    {
+        m = std::max(m, fabsf(v));
+    }
+    return m;
+}
+
+// r(x, y) = \sum_c \sum_{u, v} f_c(x + u, y + v) \cdot t_c(u, v), indices wrapped around the
+// image when circular
+std::vector<float> correlateDirectly(
+    const std::vector<float> &image,
+    const uint width,
+    const uint height,
+    const std::vector<float> &templ,
+    const uint templateWidth,
+    const uint templateHeight,
+    const uint channelCount,
+    const uint cellStride,
+    const bool circular)
+{
+    const uint resultWidth = circular ? width : width - templateWidth + 1U;
+    const uint resultHeight = circular ? height : height - templateHeight + 1U;
+    std::vector<float> r(resultWidth * resultHeight, 0.0f);
+    for (uint y = 0; y < resultHeight; ++y)
+    {
+        for (uint x = 0; x < resultWidth; ++x)
+        {
+            double sum = 0.0;
+            for (uint v = 0; v < templateHeight; ++v)
+            {
+                for (uint u = 0; u < templateWidth; ++u)
+                {
+                    const uint fx = (x + u) % width;
+                    const uint fy = (y + v) % height;
+                    for (uint c = 0; c < channelCount; ++c)
+                    {
+                        sum += image[(fx + fy * width) * cellStride + c] *
+                            templ[(u + v * templateWidth) * cellStride + c];
+                    }
+                }
+            }
+            r[x + y * resultWidth] = static_cast<float>(sum);
+        }
+    }
+    return r;
+}
+
+// k(x, z) = e^{-\max(0, \|x\|^2 + \|z\|^2 - 2 \cdot r) / (\sigma^2 \cdot N)} from the direct
+// circular correlation
+std::vector<float> correlateGaussianDirectly(
+    const std::vector<float> &image,
+    const std::vector<float> &templ,
+    const uint width,
+    const uint height,
+    const uint channelCount,
+    const uint cellStride,
+    const float sigma)
+{
+    double squaredNorms = 0.0;
+    for (uint i = 0; i < width * height; ++i)
+    {
+        for (uint c = 0; c < channelCount; ++c)
+        {
+            squaredNorms += image[i * cellStride + c] * image[i * cellStride + c] +
+                templ[i * cellStride + c] * templ[i * cellStride + c];
+        }
+    }
+    std::vector<float> k = correlateDirectly(image, width, height, templ, width, height,
+        channelCount, cellStride, true);
+    for (float &value : k)
+    {
+        const double distance = std::max(0.0, squaredNorms - 2.0 * value);
+        value = static_cast<float>(exp(-distance / (sigma * sigma * width * height *
+            channelCount)));
+    }
+    return k;
+}
+
+// Computes the HOG of a template and of an image on the device and maps their correlation
+// through GaussianCorrelation straight from the two BlockHog descriptors. hog.cl is built
+// without options, i.e. for the default HogSettings.
+class GaussianTestProcessor : public OclProcessor
+{
+public:
+    GaussianTestProcessor()
+    {
+        kernelPaths_ = { "fft.cl", "hog.cl" };
+    }
+
+    ~GaussianTestProcessor()
+    {
+        release();
+    }
+
+    bool setup(const HogSettings &settings, float sigma)
+    {
+        release();
+        if (OclProcessor::initialize() != CL_SUCCESS)
+        {
+            return false;
+        }
+        sett_ = settings;
+        templateImage_ = clCreateBuffer(oclContext_, CL_MEM_READ_ONLY, imSzInBytes(), NULL,
+            NULL);
+        image_ = clCreateBuffer(oclContext_, CL_MEM_READ_ONLY, imSzInBytes(), NULL, NULL);
+        if (!templateImage_ || !image_ ||
+            templateHog_.initialize(sett_, oclContext_, oclProgram_, templateImage_) !=
+                CL_SUCCESS ||
+            imageHog_.initialize(sett_, oclContext_, oclProgram_, image_) != CL_SUCCESS)
+        {
+            return false;
+        }
+        return gaussian_.initialize(sett_.cellCount_[0], sett_.cellCount_[1],
+            sett_.channelsPerBlock(), sett_.channelsPerBlock(), sigma, oclContext_, oclProgram_,
+            templateHog_.blockHog_.descriptor_, imageHog_.blockHog_.descriptor_) == CL_SUCCESS;
+    }
+
+    // Also reads both descriptors back
+    bool processFrame(
+        const float *templateImage,
+        const float *image,
+        float *templateDesc,
+        float *imageDesc,
+        float *dst)
+    {
+        Hog *hogs[2] = { &templateHog_, &imageHog_ };
+        const cl_mem images[2] = { templateImage_, image_ };
+        const float *srcs[2] = { templateImage, image };
+        cl_event hogEvents[2] = { NULL, NULL };
+        cl_int status = CL_SUCCESS;
+        for (int i = 0; i < 2 && status == CL_SUCCESS; ++i)
+        {
+            cl_event imWriteEvent = NULL;
+            status = clEnqueueWriteBuffer(oclQueue_, images[i], CL_FALSE, 0, imSzInBytes(),
+                srcs[i], 0, NULL, &imWriteEvent);
+            if (status == CL_SUCCESS)
+            {
+                status = hogs[i]->calculate(oclQueue_, 1, &imWriteEvent, hogEvents[i]);
+            }
+            if (imWriteEvent)
+            {
+                clReleaseEvent(imWriteEvent);
+                imWriteEvent = NULL;
+            }
+        }
+        cl_event gaussianEvent = NULL;
+        if (status == CL_SUCCESS)
+        {
+            status = gaussian_.calculate(oclQueue_, 2, hogEvents, gaussianEvent);
+        }
+        for (cl_event &hogEvent : hogEvents)
+        {
+            if (hogEvent)
+            {
+                clReleaseEvent(hogEvent);
+                hogEvent = NULL;
+            }
+        }
+        if (status == CL_SUCCESS)
+        {
+            status = clEnqueueReadBuffer(oclQueue_, gaussian_.correlation_, CL_TRUE, 0,
+                sett_.cellCount_[0] * sett_.cellCount_[1] * sizeof(cl_float), dst, 1,
+                &gaussianEvent, NULL);
+        }
+        if (gaussianEvent)
+        {
+            clReleaseEvent(gaussianEvent);
+            gaussianEvent = NULL;
+        }
+        if (status == CL_SUCCESS)
+        {
+            status = clEnqueueReadBuffer(oclQueue_, templateHog_.blockHog_.descriptor_, CL_TRUE,
+                0, sett_.descLen() * sizeof(cl_float), templateDesc, 0, NULL, NULL);
+        }
+        if (status == CL_SUCCESS)
+        {
+            status = clEnqueueReadBuffer(oclQueue_, imageHog_.blockHog_.descriptor_, CL_TRUE, 0,
+                sett_.descLen() * sizeof(cl_float), imageDesc, 0, NULL, NULL);
+        }
+        return status == CL_SUCCESS;
+    }
+
+protected:
+    int imSzInBytes() const
+    {
+        return sett_.imWidth() * sett_.imHeight() * sizeof(cl_float);
+    }
+
+    void release()
+    {
+        gaussian_.release();
+        imageHog_.release();
+        templateHog_.release();
+        if (image_)
+        {
+            clReleaseMemObject(image_);
+            image_ = NULL;
+        }
+        if (templateImage_)
+        {
+            clReleaseMemObject(templateImage_);
+            templateImage_ = NULL;
+        }
+        OclProcessor::release();
+    }
+
+    HogSettings sett_;
+    cl_mem templateImage_ = NULL;
+    cl_mem image_ = NULL;
+    Hog templateHog_;
+    Hog imageHog_;
+    GaussianCorrelation gaussian_;
+};
+
 TEST(FftTest, ocvForwardInverse)
 {
     const std::vector<float> src{ 12.345f, -1.0f, 42.0f, 0.0f, 0.0f, -0.05f, 10.0f, 3.14159265f };
@@ -67,6 +395,215 @@ TEST(FftTest, protoAgainstOpenCV)
     }
 }
 
+TEST(FftTest, protoMixedRadixAgainstOpenCV)
+{
+    for (const uint N : { 96U, 120U, 168U, 210U, 336U, 480U })
+    {
+        const std::vector<float> src = generateRandomData(N);
+        cv::Mat ocv;
+        cv::dft(src, ocv, cv::DFT_COMPLEX_OUTPUT);
+
+        FftProto ours;
+        ASSERT_TRUE(ours.init(N));
+        ASSERT_TRUE(ours.calcForward(src.data()));
+        for (uint i = 0; i < N; ++i)
+        {
+            for (uint dim = 0; dim < 2; ++dim)
+            {
+                const float expected = ocv.at<cv::Vec2f>(0, i)[dim];
+                ASSERT_LE(fabsf(ours.result()[2 * i + dim] - expected), 1e-3f * N);
+            }
+        }
+    }
+}
+
+TEST(FftTest, protoBluesteinAgainstOpenCV)
+{
+    for (const uint N : { 11U, 13U, 97U, 121U, 202U, 1009U })
+    {
+        const std::vector<float> src = generateRandomData(N);
+        cv::Mat ocv;
+        cv::dft(src, ocv, cv::DFT_COMPLEX_OUTPUT);
+
+        for (const FftAlgorithm algorithm : { FftAlgorithm::digitReversal, FftAlgorithm::stockham })
+        {
+            FftProto ours;
+            ASSERT_TRUE(ours.init(N, nullptr, algorithm));
+            ASSERT_TRUE(ours.isBluestein());
+            ASSERT_TRUE(ours.calcForward(src.data()));
+            std::vector<float> transformed(2 * N, 0.0f);
+            for (uint i = 0; i < N; ++i)
+            {
+                for (uint dim = 0; dim < 2; ++dim)
+                {
+                    const float expected = ocv.at<cv::Vec2f>(0, i)[dim];
+                    transformed[2 * i + dim] = ours.result()[2 * i + dim];
+                    ASSERT_LE(fabsf(transformed[2 * i + dim] - expected), 1e-3f * N);
+                }
+            }
+            ASSERT_TRUE(ours.calc(transformed.data(), true));
+            for (uint i = 0; i < N; ++i)
+            {
+                ASSERT_LE(fabsf(ours.result()[2 * i] - src[i]), 1e-3f);
+                ASSERT_LE(fabsf(ours.result()[2 * i + 1]), 1e-3f);
+            }
+        }
+    }
+}
+
+TEST(FftTest, protoBatchBluesteinAgainstSingle)
+{
+    const uint N = 97U;
+    const uint lineCount = 5U;
+    std::vector<float> data = generateRandomData(2 * N * lineCount);
+    const std::vector<float> src = data;
+    FftBatchProto batch;
+    ASSERT_TRUE(batch.init(N));
+    ASSERT_EQ(batch.laneCount(), 1U);
+    // Columns of an N x lineCount buffer
+    ASSERT_TRUE(batch.calc(data.data(), lineCount, 1U, lineCount, false));
+
+    FftProto single;
+    ASSERT_TRUE(single.init(N));
+    std::vector<float> line(2 * N, 0.0f);
+    for (uint l = 0; l < lineCount; ++l)
+    {
+        for (uint n = 0; n < N; ++n)
+        {
+            line[2 * n] = src[2 * (l + n * lineCount)];
+            line[2 * n + 1] = src[2 * (l + n * lineCount) + 1];
+        }
+        ASSERT_TRUE(single.calc(line.data(), false));
+        for (uint n = 0; n < N; ++n)
+        {
+            ASSERT_EQ(single.result()[2 * n], data[2 * (l + n * lineCount)]);
+            ASSERT_EQ(single.result()[2 * n + 1], data[2 * (l + n * lineCount) + 1]);
+        }
+    }
+}
+
+TEST(FftTest, cheapestSize)
+{
+    ASSERT_TRUE(isRadixFftSize(210U));
+    ASSERT_FALSE(isRadixFftSize(97U));
+    ASSERT_EQ(getNextRadixFftSize(97U), 98U);
+    ASSERT_EQ(getNextRadixFftSize(193U), 196U);
+    // Bluestein made artificially expensive: the next radix size wins, unless out of range
+    const auto cost = [](uint N) { return isRadixFftSize(N) ? static_cast<double>(N) : 1e6; };
+    ASSERT_EQ(findCheapestFftSize(97U, 120U, cost), 98U);
+    ASSERT_EQ(findCheapestFftSize(97U, 97U, cost), 97U);
+    ASSERT_EQ(findCheapestFftSize(96U, 120U, cost), 96U);
+    // Sizes are only ever compared by cost
+    const auto preferPowerOfTwo = [](uint N) { return (N & (N - 1U)) ? 2.0 : 1.0; };
+    ASSERT_EQ(findCheapestFftSize(97U, 130U, preferPowerOfTwo), 128U);
+}
+
+TEST(FftTest, wisdom)
+{
+    const std::vector<std::vector<uint>> candidates = FftWisdom::getStageCandidates(16U);
+    ASSERT_EQ(candidates, (std::vector<std::vector<uint>>{ { 8U, 2U }, { 4U, 4U }, { 4U, 2U, 2U },
+        { 2U, 2U, 2U, 2U }, { 2U, 8U }, { 2U, 2U, 4U } }));
+    ASSERT_TRUE(FftWisdom::getStageCandidates(97U).empty());
+
+    FftWisdom wisdom;
+    ASSERT_EQ(wisdom.find(96U), nullptr);
+    for (const uint N : { 96U, 97U })
+    {
+        const FftWisdom::Plan *plan = wisdom.tune(N, 4);
+        ASSERT_NE(plan, nullptr);
+        ASSERT_EQ(wisdom.find(N), plan);
+        ASSERT_EQ(plan->stages_.empty(), N == 97U);
+
+        // Any tuned plan computes the same transform as the default one
+        const std::vector<float> src = generateRandomData(2 * N);
+        FftProto tuned, reference;
+        ASSERT_TRUE(tuned.init(N, plan->stagesOrNull(), plan->algorithm_));
+        ASSERT_TRUE(reference.init(N));
+        ASSERT_TRUE(tuned.calc(src.data(), false));
+        ASSERT_TRUE(reference.calc(src.data(), false));
+        for (uint i = 0; i < 2 * N; ++i)
+        {
+            ASSERT_LE(fabsf(tuned.result()[i] - reference.result()[i]), 1e-3f * N);
+        }
+    }
+
+    const std::string path = "fftwisdom_test.txt";
+    ASSERT_TRUE(wisdom.save(path));
+    FftWisdom loaded;
+    ASSERT_TRUE(loaded.load(path));
+    for (const uint N : { 96U, 97U })
+    {
+        ASSERT_NE(loaded.find(N), nullptr);
+        ASSERT_EQ(loaded.find(N)->stages_, wisdom.find(N)->stages_);
+        ASSERT_EQ(loaded.find(N)->algorithm_, wisdom.find(N)->algorithm_);
+    }
+
+    // Stages that do not multiply to N are rejected, the plans in memory are kept
+    {
+        std::ofstream file(path);
+        file << "64 stockham 1.0 8 4\n";
+    }
+    ASSERT_FALSE(loaded.load(path));
+    ASSERT_EQ(loaded.find(64U), nullptr);
+    ASSERT_NE(loaded.find(96U), nullptr);
+    std::remove(path.c_str());
+    ASSERT_FALSE(loaded.load(path));
+}
+
+TEST(FftTest, wisdom2dFromLoadedPlan)
+{
+    // Plans an earlier process could have saved, none of them the default order of its size
+    const std::string path = "fftwisdom2d_test.txt";
+    {
+        std::ofstream file(path);
+        file << "48 digitReversal 1.0 2 2 3 4\n40 stockham 1.0 2 5 4\n24 digitReversal 1.0 2 3 4\n";
+    }
+    FftWisdom wisdom;
+    ASSERT_TRUE(wisdom.load(path));
+    std::remove(path.c_str());
+    const uint width = 48U;
+    const uint height = 40U;
+    const std::vector<float> src = generateRandomData(2 * width * height);
+    // Relative to the largest possible bin, 100 * width * height
+    const float eps = 1e-4f * width * height;
+
+    Fft2dProto tuned, reference;
+    ASSERT_TRUE(tuned.init(width, height, FftAlgorithm::stockham, FftColumns::strided, nullptr,
+        &wisdom));
+    ASSERT_TRUE(reference.init(width, height, FftAlgorithm::stockham));
+    ASSERT_TRUE(tuned.calc(src.data(), false));
+    ASSERT_TRUE(reference.calc(src.data(), false));
+    for (uint i = 0; i < 2 * width * height; ++i)
+    {
+        ASSERT_LE(fabsf(tuned.result()[i] - reference.result()[i]), eps);
+    }
+
+    const uint channelCount = 3U;
+    Fft2dChannelsProto tunedChannels, referenceChannels;
+    ASSERT_TRUE(tunedChannels.init(width, height, channelCount,
+        FftAlgorithm::stockham, &wisdom));
+    ASSERT_TRUE(referenceChannels.init(width, height, channelCount, FftAlgorithm::stockham));
+    const std::vector<float> channelsSrc = generateRandomData(width * height * channelCount);
+    ASSERT_TRUE(tunedChannels.calcForward(channelsSrc.data(), channelCount));
+    ASSERT_TRUE(referenceChannels.calcForward(channelsSrc.data(), channelCount));
+    for (uint i = 0; i < 2 * width * height * channelCount; ++i)
+    {
+        ASSERT_LE(fabsf(tunedChannels.result()[i] - referenceChannels.result()[i]), eps);
+    }
+
+    // The packed rows of the real transform are 24 long
+    Fft2dRealProto tunedReal, referenceReal;
+    ASSERT_TRUE(tunedReal.init(width, height, FftAlgorithm::stockham, FftColumns::strided,
+        &wisdom));
+    ASSERT_TRUE(referenceReal.init(width, height, FftAlgorithm::stockham));
+    ASSERT_TRUE(tunedReal.calcForward(src.data()));
+    ASSERT_TRUE(referenceReal.calcForward(src.data()));
+    for (uint i = 0; i < 2 * tunedReal.spectrumWidth() * height; ++i)
+    {
+        ASSERT_LE(fabsf(tunedReal.result()[i] - referenceReal.result()[i]), eps);
+    }
+}
+
 TEST(FftTest, protoForwardInverse)
 {
     const std::vector<uint> stages{ 2, 3, 4, 5, 6, 7, 8 };
@@ -87,6 +624,85 @@ TEST(FftTest, protoForwardInverse)
     }
 }
 
+TEST(FftTest, protoStockhamAgainstDigitReversal)
+{
+    for (const std::vector<uint> &stages : std::vector<std::vector<uint> >{
+            { 2, 3, 4, 5, 6, 7, 8 }, { 8, 8, 8 }, { 5 }, { 3, 4 }, { 7, 2, 6, 3 } })
+    {
+        const uint N = generateRandomData(stages).size();
+        const std::vector<float> src = generateRandomData(2 * N);
+
+        FftProto digitReversal;
+        ASSERT_TRUE(digitReversal.init(N, &stages, FftAlgorithm::digitReversal));
+        FftProto stockham;
+        ASSERT_TRUE(stockham.init(N, &stages, FftAlgorithm::stockham));
+        for (const bool inverse : { false, true })
+        {
+            ASSERT_TRUE(digitReversal.calc(src.data(), inverse));
+            ASSERT_TRUE(stockham.calc(src.data(), inverse));
+            for (uint i = 0; i < 2 * N; ++i)
+            {
+                ASSERT_LE(fabsf(stockham.result()[i] - digitReversal.result()[i]), 1e-3f);
+            }
+        }
+        ASSERT_TRUE(digitReversal.calcForward(src.data()));
+        ASSERT_TRUE(stockham.calcForward(src.data()));
+        for (uint i = 0; i < 2 * N; ++i)
+        {
+            ASSERT_LE(fabsf(stockham.result()[i] - digitReversal.result()[i]), 1e-3f);
+        }
+    }
+}
+
+TEST(FftTest, protoBatchAgainstSingle)
+{
+    const uint N = 48U;
+    const uint lineCount = 13U;
+    const std::vector<float> src = generateRandomData(2 * N * lineCount);
+    for (const FftAlgorithm algorithm : { FftAlgorithm::digitReversal, FftAlgorithm::stockham })
+    {
+        FftProto single;
+        ASSERT_TRUE(single.init(N, nullptr, algorithm));
+        for (const uint maxLaneCount : { 4U, 8U })
+        {
+            FftBatchProto batch;
+            ASSERT_TRUE(batch.init(N, algorithm, maxLaneCount));
+            ASSERT_LE(batch.laneCount(), maxLaneCount);
+            for (const bool inverse : { false, true })
+            {
+                // Lines as rows (contiguous) and as columns (strided)
+                std::vector<float> rows = src;
+                ASSERT_TRUE(batch.calc(rows.data(), lineCount, N, 1U, inverse));
+                std::vector<float> cols = src;
+                ASSERT_TRUE(batch.calc(cols.data(), lineCount, 1U, lineCount, inverse));
+                std::vector<float> line(2 * N, 0.0f);
+                for (uint l = 0; l < lineCount; ++l)
+                {
+                    ASSERT_TRUE(single.calc(src.data() + 2 * l * N, inverse));
+                    for (uint i = 0; i < 2 * N; ++i)
+                    {
+                        ASSERT_LE(fabsf(rows[2 * l * N + i] - single.result()[i]), 1e-3f);
+                    }
+                    for (uint n = 0; n < N; ++n)
+                    {
+                        line[2 * n] = src[2 * (n * lineCount + l)];
+                        line[2 * n + 1] = src[2 * (n * lineCount + l) + 1];
+                    }
+                    ASSERT_TRUE(single.calc(line.data(), inverse));
+                    for (uint n = 0; n < N; ++n)
+                    {
+                        for (uint dim = 0; dim < 2; ++dim)
+                        {
+                            ASSERT_LE(fabsf(cols[2 * (n * lineCount + l) + dim] -
+                                single.result()[2 * n + dim]), 1e-3f);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
 TEST(FftTest, proto2dForwardInverse)
 {
     const uint width = 64U;
@@ -94,17 +710,810 @@ TEST(FftTest, proto2dForwardInverse)
     const std::vector<float> src = generateRandomData(width * height);
     const float eps = 1e-4f;
 
-    Fft2dProto ours;
-    ASSERT_TRUE(ours.init(width, height));
-    ASSERT_TRUE(ours.calcForward(src.data()));
-    std::vector<float> transformed(src.size() * 2, 0.0f);
-    std::copy(ours.result(), ours.result() + transformed.size(), transformed.data());
-    ASSERT_TRUE(ours.calc(transformed.data(), true));
+    for (const FftColumns columns : { FftColumns::transposed, FftColumns::strided })
+    {
+        Fft2dProto ours;
+        ASSERT_TRUE(ours.init(width, height, FftAlgorithm::digitReversal, columns));
+        ASSERT_TRUE(ours.calcForward(src.data()));
+        std::vector<float> transformed(src.size() * 2, 0.0f);
+        std::copy(ours.result(), ours.result() + transformed.size(), transformed.data());
+        ASSERT_TRUE(ours.calc(transformed.data(), true));
 
-    for (size_t i = 0; i < src.size(); ++i)
+        for (size_t i = 0; i < src.size(); ++i)
+        {
+            ASSERT_LE(fabsf(ours.result()[2 * i] - src[i]), eps);
+            ASSERT_LE(fabsf(ours.result()[2 * i + 1]), eps);
+        }
+    }
+}
+
+TEST(FftTest, proto2dStridedAgainstTransposed)
+{
+    // Odd sizes leave partial lane groups in both passes
+    for (const std::array<uint, 2> &size : { std::array<uint, 2>{ 96U, 160U },
+            std::array<uint, 2>{ 15U, 21U }, std::array<uint, 2>{ 7U, 1U } })
     {
-        ASSERT_LE(fabsf(ours.result()[2 * i] - src[i]), eps);
-        ASSERT_LE(fabsf(ours.result()[2 * i + 1]), eps);
+        const std::vector<float> src = generateRandomData(2 * size[0] * size[1]);
+        Fft2dProto transposed;
+        ASSERT_TRUE(transposed.init(size[0], size[1], FftAlgorithm::stockham,
+            FftColumns::transposed));
+        Fft2dProto strided;
+        ASSERT_TRUE(strided.init(size[0], size[1], FftAlgorithm::stockham, FftColumns::strided));
+        for (const bool inverse : { false, true })
+        {
+            ASSERT_TRUE(transposed.calc(src.data(), inverse));
+            ASSERT_TRUE(strided.calc(src.data(), inverse));
+            for (size_t i = 0; i < src.size(); ++i)
+            {
+                ASSERT_LE(fabsf(transposed.result()[i] - strided.result()[i]), 1e-2f);
+            }
+        }
     }
 }
 
+TEST(FftTest, proto2dCallerBuffers)
+{
+    // A window of a larger arena, a non-radix width goes through the Bluestein lines
+    for (const std::array<uint, 2> &size : { std::array<uint, 2>{ 48U, 30U },
+            std::array<uint, 2>{ 17U, 12U } })
+    {
+        const uint width = size[0];
+        const uint height = size[1];
+        const uint stride = width + 5U;
+        const std::vector<float> src = generateRandomData(2 * width * height);
+        std::vector<float> arena = generateRandomData(2 * stride * (height + 2U));
+        float *window = arena.data() + 2 * (stride + 3U);
+        for (uint y = 0; y < height; ++y)
+        {
+            std::copy(src.begin() + 2 * y * width, src.begin() + 2 * (y + 1U) * width,
+                window + 2 * y * stride);
+        }
+        const std::vector<float> arenaBefore = arena;
+        for (const FftColumns columns : { FftColumns::transposed, FftColumns::strided })
+        {
+            Fft2dProto fft;
+            ASSERT_TRUE(fft.init(width, height, FftAlgorithm::stockham, columns));
+            ASSERT_TRUE(fft.calc(src.data(), false));
+            const std::vector<float> expected(fft.result(), fft.result() + src.size());
+
+            // Out of place into the window, then back in place, leaving the arena around it
+            std::vector<float> inPlace = arena;
+            float *inPlaceWindow = inPlace.data() + 2 * (stride + 3U);
+            ASSERT_TRUE(fft.calc(src.data(), width, inPlaceWindow, stride, false));
+            for (uint y = 0; y < height; ++y)
+            {
+                for (uint i = 0; i < 2 * width; ++i)
+                {
+                    const float expectedValue = expected[2 * y * width + i];
+                    ASSERT_LE(fabsf(inPlaceWindow[2 * y * stride + i] - expectedValue), 1e-2f);
+                }
+            }
+            ASSERT_TRUE(fft.calc(inPlaceWindow, stride, inPlaceWindow, stride, true));
+            ASSERT_FALSE(fft.calc(inPlaceWindow, stride, inPlaceWindow, width, true));
+            for (size_t i = 0; i < arena.size(); ++i)
+            {
+                ASSERT_LE(fabsf(inPlace[i] - arenaBefore[i]), 1e-2f);
+            }
+            // The internal result is not touched by the caller-buffer calls
+            for (size_t i = 0; i < expected.size(); ++i)
+            {
+                ASSERT_EQ(fft.result()[i], expected[i]);
+            }
+        }
+    }
+
+    FftProto single;
+    ASSERT_TRUE(single.init(48U));
+    const std::vector<float> line = generateRandomData(2 * 48U);
+    std::vector<float> dst(line.size(), 0.0f);
+    ASSERT_TRUE(single.calc(line.data(), false));
+    ASSERT_TRUE(single.calc(line.data(), dst.data(), false));
+    ASSERT_TRUE(std::equal(dst.begin(), dst.end(), single.result()));
+    ASSERT_FALSE(single.calc(dst.data(), dst.data(), false));
+}
+
+TEST(FftTest, proto2dPrunedAgainstFull)
+{
+    const uint width = 48U;
+    const uint height = 30U;
+    Fft2dProto fft;
+    ASSERT_TRUE(fft.init(width, height, FftAlgorithm::stockham));
+    // Wide and short windows go rows first, narrow and tall ones columns first
+    for (const std::array<uint, 4> &rect : { std::array<uint, 4>{ 5U, 3U, 40U, 7U },
+            std::array<uint, 4>{ 2U, 1U, 9U, 28U }, std::array<uint, 4>{ 0U, 0U, 48U, 30U } })
+    {
+        const FftRect window{ rect[0], rect[1], rect[2], rect[3] };
+        const std::vector<float> valid = generateRandomData(2 * window.width_ * window.height_);
+        std::vector<float> padded(2 * width * height, 0.0f);
+        for (uint y = 0; y < window.height_; ++y)
+        {
+            std::copy(valid.begin() + 2 * y * window.width_,
+                valid.begin() + 2 * (y + 1U) * window.width_,
+                padded.begin() + 2 * ((window.y_ + y) * width + window.x_));
+        }
+        ASSERT_TRUE(fft.calc(padded.data(), false));
+        const std::vector<float> spectrum(fft.result(), fft.result() + padded.size());
+
+        std::vector<float> pruned(padded.size(), 1.0f);
+        ASSERT_TRUE(fft.calcForwardPruned(valid.data(), window.width_, window, pruned.data(),
+            width));
+        for (size_t i = 0; i < spectrum.size(); ++i)
+        {
+            ASSERT_LE(fabsf(pruned[i] - spectrum[i]), 1e-2f);
+        }
+
+        // The same window is cropped out of the inverse of the spectrum
+        const uint stride = window.width_ + 3U;
+        std::vector<float> cropped(2 * stride * window.height_, 1.0f);
+        ASSERT_TRUE(fft.calcInversePruned(spectrum.data(), width, window, cropped.data(), stride));
+        for (uint y = 0; y < window.height_; ++y)
+        {
+            for (uint i = 0; i < 2 * window.width_; ++i)
+            {
+                ASSERT_LE(fabsf(cropped[2 * y * stride + i] - valid[2 * y * window.width_ + i]),
+                    1e-2f);
+            }
+            for (uint i = 2 * window.width_; i < 2 * stride; ++i)
+            {
+                ASSERT_EQ(cropped[2 * y * stride + i], 1.0f);
+            }
+        }
+    }
+    const FftRect outside{ 40U, 0U, 9U, 30U };
+    std::vector<float> buffer(2 * width * height, 0.0f);
+    ASSERT_FALSE(fft.calcForwardPruned(buffer.data(), width, outside, buffer.data(), width));
+    ASSERT_FALSE(fft.calcInversePruned(buffer.data(), width, FftRect(), buffer.data(), width));
+}
+
+TEST(FftTest, proto2dParallelAgainstSerial)
+{
+    ThreadPool threadPool;
+    ASSERT_TRUE(threadPool.init(3));
+    // 8x8 stays below the parallel threshold; 5 lanes of 160 leave two threads idle
+    for (const std::array<uint, 2> &size : { std::array<uint, 2>{ 96U, 160U },
+            std::array<uint, 2>{ 5U, 1000U }, std::array<uint, 2>{ 8U, 8U } })
+    {
+        for (const FftColumns columns : { FftColumns::transposed, FftColumns::strided })
+        {
+            const std::vector<float> src = generateRandomData(2 * size[0] * size[1]);
+            Fft2dProto serial;
+            ASSERT_TRUE(serial.init(size[0], size[1], FftAlgorithm::stockham, columns));
+            Fft2dProto parallel;
+            ASSERT_TRUE(parallel.init(size[0], size[1], FftAlgorithm::stockham, columns,
+                &threadPool));
+            for (const bool inverse : { false, true })
+            {
+                ASSERT_TRUE(serial.calc(src.data(), inverse));
+                ASSERT_TRUE(parallel.calc(src.data(), inverse));
+                for (size_t i = 0; i < src.size(); ++i)
+                {
+                    ASSERT_EQ(serial.result()[i], parallel.result()[i]);
+                }
+            }
+        }
+    }
+}
+
+TEST(FftTest, threadPoolReinit)
+{
+    ThreadPool threadPool;
+    for (int i = 0; i < 2; ++i)
+    {
+        ASSERT_TRUE(threadPool.init(4));
+        // Parked workers of a re-initialised pool must not wake up before run
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        for (int repeat = 0; repeat < 2; ++repeat)
+        {
+            std::vector<int> calls(threadPool.threadCount(), 0);
+            threadPool.run([&calls](int index) { ++calls[index]; });
+            for (const int count : calls)
+            {
+                ASSERT_EQ(1, count);
+            }
+        }
+    }
+}
+
+TEST(FftTest, oclAgainstProto)
+{
+    for (const std::array<uint, 2> &size : { std::array<uint, 2>{ 64U, 48U },
+            std::array<uint, 2>{ 96U, 160U }, std::array<uint, 2>{ 45U, 30U } })
+    {
+        const uint width = size[0];
+        const uint height = size[1];
+        const std::vector<float> src = generateRandomData(2 * width * height);
+        for (const FftPasses passes : { FftPasses::rows, FftPasses::rowsAndColumns })
+        {
+            for (const bool inverse : { false, true })
+            {
+                std::vector<float> expected(src.size(), 0.0f);
+                if (passes == FftPasses::rows)
+                {
+                    FftProto proto;
+                    ASSERT_TRUE(proto.init(width));
+                    for (uint y = 0; y < height; ++y)
+                    {
+                        ASSERT_TRUE(proto.calc(src.data() + 2 * width * y, inverse));
+                        std::copy(proto.result(), proto.result() + 2 * width,
+                            expected.data() + 2 * width * y);
+                    }
+                }
+                else
+                {
+                    Fft2dProto proto;
+                    ASSERT_TRUE(proto.init(width, height));
+                    ASSERT_TRUE(proto.calc(src.data(), inverse));
+                    std::copy(proto.result(), proto.result() + src.size(), expected.data());
+                }
+
+                FftTestProcessor ocl;
+                ASSERT_TRUE(ocl.setup(width, height, passes, inverse));
+                std::vector<float> oclDst(src.size(), 0.0f);
+                ASSERT_TRUE(ocl.processFrame(src.data(), oclDst.data()));
+
+                float maxMagnitude = 0.0f;
+                for (const float value : expected)
+                {
+                    maxMagnitude = fmaxf(maxMagnitude, fabsf(value));
+                }
+                for (size_t i = 0; i < src.size(); ++i)
+                {
+                    ASSERT_LE(fabsf(oclDst[i] - expected[i]), 1e-4f * maxMagnitude);
+                }
+            }
+        }
+    }
+}
+
+TEST(FftTest, oclRealChannelsAgainstProto)
+{
+    // The HOG descriptor layout (31 channels per cell), and fewer channels than the cell has
+    for (const std::array<uint, 4> &size : { std::array<uint, 4>{ 24U, 16U, 31U, 31U },
+            std::array<uint, 4>{ 45U, 30U, 3U, 5U } })
+    {
+        const uint width = size[0];
+        const uint height = size[1];
+        const uint channelCount = size[2];
+        const uint cellStride = size[3];
+        const std::vector<float> src = generateRandomData(width * height * cellStride);
+        FftTestProcessor ocl;
+        ASSERT_TRUE(ocl.setupRealChannels(width, height, channelCount, cellStride,
+            FftPasses::rowsAndColumns));
+        std::vector<float> oclDst(2 * width * height * channelCount, 0.0f);
+        ASSERT_TRUE(ocl.processFrame(src.data(), oclDst.data()));
+
+        // Channel c of cell i lands at i * channelCount + c
+        Fft2dProto proto;
+        ASSERT_TRUE(proto.init(width, height));
+        std::vector<float> plane(width * height, 0.0f);
+        for (uint c = 0; c < channelCount; ++c)
+        {
+            for (uint i = 0; i < width * height; ++i)
+            {
+                plane[i] = src[i * cellStride + c];
+            }
+            ASSERT_TRUE(proto.calcForward(plane.data()));
+            float maxMagnitude = 0.0f;
+            for (uint i = 0; i < 2 * width * height; ++i)
+            {
+                maxMagnitude = fmaxf(maxMagnitude, fabsf(proto.result()[i]));
+            }
+            for (uint i = 0; i < width * height; ++i)
+            {
+                for (uint dim = 0; dim < 2; ++dim)
+                {
+                    ASSERT_LE(fabsf(oclDst[2 * (i * channelCount + c) + dim] -
+                        proto.result()[2 * i + dim]), 1e-4f * maxMagnitude);
+                }
+            }
+        }
+    }
+}
+
+TEST(FftTest, proto2dChannelsAgainstPlanes)
+{
+    // HOG-like: 31 channels with a padded cell stride
+    const uint width = 24U;
+    const uint height = 15U;
+    const uint channelCount = 31U;
+    const uint cellStride = 32U;
+    const std::vector<float> src = generateRandomData(width * height * cellStride);
+    Fft2dChannelsProto channels;
+    ASSERT_TRUE(channels.init(width, height, channelCount));
+    ASSERT_TRUE(channels.calcForward(src.data(), cellStride));
+    const std::vector<float> spectrum(channels.result(),
+        channels.result() + 2 * width * height * channelCount);
+    ASSERT_TRUE(channels.calc(spectrum.data(), true));
+
+    Fft2dProto plane;
+    ASSERT_TRUE(plane.init(width, height));
+    std::vector<float> planeSrc(width * height, 0.0f);
+    for (uint c = 0; c < channelCount; ++c)
+    {
+        for (uint i = 0; i < width * height; ++i)
+        {
+            planeSrc[i] = src[i * cellStride + c];
+        }
+        ASSERT_TRUE(plane.calcForward(planeSrc.data()));
+        for (uint i = 0; i < width * height; ++i)
+        {
+            for (uint dim = 0; dim < 2; ++dim)
+            {
+                ASSERT_LE(fabsf(plane.result()[2 * i + dim] -
+                    spectrum[2 * (i * channelCount + c) + dim]), 1e-2f);
+            }
+            ASSERT_LE(fabsf(channels.result()[2 * (i * channelCount + c)] - planeSrc[i]), 1e-3f);
+            ASSERT_LE(fabsf(channels.result()[2 * (i * channelCount + c) + 1]), 1e-3f);
+        }
+    }
+}
+
+TEST(FftTest, correlationCircularAgainstDirect)
+{
+    // Fewer channels than lanes, more channels than lanes and a Bluestein width
+    for (const std::array<uint, 4> &size : { std::array<uint, 4>{ 12U, 10U, 3U, 4U },
+            std::array<uint, 4>{ 8U, 6U, 11U, 11U }, std::array<uint, 4>{ 11U, 6U, 2U, 2U } })
+    {
+        const uint width = size[0];
+        const uint height = size[1];
+        const uint channelCount = size[2];
+        const uint cellStride = size[3];
+        const std::vector<float> image = generateRandomData(width * height * cellStride);
+        std::vector<float> templ = image;
+        std::reverse(templ.begin(), templ.end());
+        FftCorrelationProto correlation;
+        ASSERT_TRUE(correlation.init(width, height, channelCount));
+        ASSERT_TRUE(correlation.setTemplate(templ.data(), cellStride));
+        ASSERT_TRUE(correlation.calc(image.data(), cellStride));
+        ASSERT_EQ(correlation.resultWidth(), width);
+        ASSERT_EQ(correlation.resultHeight(), height);
+        const std::vector<float> expected = correlateDirectly(image, width, height, templ, width,
+            height, channelCount, cellStride, true);
+        const float eps = 1e-5f * maxAbs(expected);
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            ASSERT_LE(fabsf(correlation.result()[i] - expected[i]), eps);
+        }
+    }
+}
+
+TEST(FftTest, correlationOverlapSaveAgainstDirect)
+{
+    const uint width = 61U;
+    const uint height = 37U;
+    const uint templateWidth = 9U;
+    const uint templateHeight = 7U;
+    const uint channelCount = 2U;
+    const std::vector<float> image = generateRandomData(width * height * channelCount);
+    std::vector<float> templ(image.begin(), image.begin() + templateWidth * templateHeight *
+        channelCount);
+    std::reverse(templ.begin(), templ.end());
+    const std::vector<float> expected = correlateDirectly(image, width, height, templ,
+        templateWidth, templateHeight, channelCount, channelCount, false);
+    // Picked tiles, a single tile, an odd number of tiles with partial edge tiles
+    for (const std::array<uint, 2> &tile : { std::array<uint, 2>{ 0U, 0U },
+            std::array<uint, 2>{ 64U, 40U }, std::array<uint, 2>{ 16U, 15U } })
+    {
+        FftCorrelationProto correlation;
+        ASSERT_TRUE(correlation.initOverlapSave(width, height, templateWidth, templateHeight,
+            channelCount, tile[0], tile[1]));
+        ASSERT_TRUE(correlation.setTemplate(templ.data(), channelCount));
+        ASSERT_TRUE(correlation.calc(image.data(), channelCount));
+        ASSERT_EQ(correlation.resultWidth(), width - templateWidth + 1U);
+        ASSERT_EQ(correlation.resultHeight(), height - templateHeight + 1U);
+        const float eps = 1e-5f * maxAbs(expected);
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            ASSERT_LE(fabsf(correlation.result()[i] - expected[i]), eps);
+        }
+    }
+    FftCorrelationProto correlation;
+    ASSERT_FALSE(correlation.initOverlapSave(width, height, width + 1U, 1U, 1U));
+    ASSERT_FALSE(correlation.initOverlapSave(width, height, templateWidth, templateHeight, 1U,
+        8U, 8U));
+}
+
+TEST(FftTest, correlationGaussianAgainstDirect)
+{
+    const float sigma = 0.5f;
+    for (const std::array<uint, 4> &size : { std::array<uint, 4>{ 12U, 10U, 3U, 4U },
+            std::array<uint, 4>{ 8U, 6U, 31U, 32U }, std::array<uint, 4>{ 11U, 6U, 2U, 2U } })
+    {
+        const uint width = size[0];
+        const uint height = size[1];
+        const uint channelCount = size[2];
+        const uint cellStride = size[3];
+        // Values in [-1, 1] and a template which is the image shifted by (3, 2) cells, so that
+        // the responses cover the whole (0, 1] range
+        std::vector<float> image = generateRandomData(width * height * cellStride);
+        for (float &value : image)
+        {
+            value *= 0.01f;
+        }
+        std::vector<float> templ(image.size(), 0.0f);
+        for (uint i = 0; i < width * height; ++i)
+        {
+            const uint shifted = (i % width + 3U) % width + (i / width + 2U) % height * width;
+            std::copy(&image[shifted * cellStride], &image[shifted * cellStride] + cellStride,
+                &templ[i * cellStride]);
+        }
+        FftCorrelationProto correlation;
+        ASSERT_TRUE(correlation.init(width, height, channelCount));
+        ASSERT_TRUE(correlation.setTemplate(templ.data(), cellStride));
+        ASSERT_TRUE(correlation.calcGaussian(image.data(), cellStride, sigma));
+        const std::vector<float> expected = correlateGaussianDirectly(image, templ, width,
+            height, channelCount, cellStride, sigma);
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            ASSERT_LE(fabsf(correlation.result()[i] - expected[i]), 1e-4f);
+        }
+        ASSERT_LE(fabsf(*std::max_element(correlation.result(), correlation.result() +
+            width * height) - 1.0f), 1e-4f);
+        ASSERT_FALSE(correlation.calcGaussian(image.data(), cellStride, 0.0f));
+    }
+}
+
+TEST(FftTest, oclGaussianAgainstProto)
+{
+    // The template is the image shifted by two cells, as a tracker would correlate the model
+    // with the next frame
+    HogSettings settings;
+    ASSERT_TRUE(settings.init(96, 64));
+    const uint width = settings.cellCount_[0];
+    const uint height = settings.cellCount_[1];
+    const uint channelCount = settings.channelsPerBlock();
+    const float sigma = 0.2f;
+    std::vector<float> image = generateRandomData(settings.imWidth() * settings.imHeight());
+    for (float &value : image)
+    {
+        value += 100.0f;
+    }
+    std::vector<float> templ(image.size());
+    for (int y = 0; y < settings.imHeight(); ++y)
+    {
+        const float *row = image.data() + y * settings.imWidth();
+        std::rotate_copy(row, row + 2 * settings.cellSize_, row + settings.imWidth(),
+            templ.data() + y * settings.imWidth());
+    }
+
+    GaussianTestProcessor ocl;
+    ASSERT_TRUE(ocl.setup(settings, sigma));
+    std::vector<float> templateDesc(settings.descLen(), 0.0f);
+    std::vector<float> imageDesc(settings.descLen(), 0.0f);
+    std::vector<float> oclDst(width * height, 0.0f);
+    ASSERT_TRUE(ocl.processFrame(templ.data(), image.data(), templateDesc.data(),
+        imageDesc.data(), oclDst.data()));
+
+    FftCorrelationProto correlation;
+    ASSERT_TRUE(correlation.init(width, height, channelCount));
+    ASSERT_TRUE(correlation.setTemplate(templateDesc.data(), channelCount));
+    ASSERT_TRUE(correlation.calcGaussian(imageDesc.data(), channelCount, sigma));
+    for (uint i = 0; i < width * height; ++i)
+    {
+        ASSERT_LE(fabsf(oclDst[i] - correlation.result()[i]), 1e-4f);
+    }
+    // The peak is at the shift of the template
+    ASSERT_EQ(std::max_element(oclDst.begin(), oclDst.end()) - oclDst.begin(), 2);
+}
+
+TEST(FftTest, protoRealAgainstComplex)
+{
+    for (const uint N : { 8U, 30U, 64U, 210U, 9U, 45U })
+    {
+        const std::vector<float> src = generateRandomData(N);
+        const float eps = 1e-5f * N * 100.0f;
+
+        FftProto complex;
+        ASSERT_TRUE(complex.init(N));
+        ASSERT_TRUE(complex.calcForward(src.data()));
+        FftRealProto ours;
+        ASSERT_TRUE(ours.init(N));
+        ASSERT_TRUE(ours.calcForward(src.data()));
+        for (uint i = 0; i < 2 * ours.spectrumLength(); ++i)
+        {
+            ASSERT_LE(fabsf(ours.result()[i] - complex.result()[i]), eps);
+        }
+
+        std::vector<float> spectrum(ours.result(), ours.result() + 2 * ours.spectrumLength());
+        ASSERT_TRUE(ours.calcInverse(spectrum.data()));
+        for (uint i = 0; i < N; ++i)
+        {
+            ASSERT_LE(fabsf(ours.result()[i] - src[i]), 1e-4f);
+        }
+    }
+}
+
+TEST(FftTest, proto2dRealAgainstComplex)
+{
+    for (const std::array<uint, 2> &size : { std::array<uint, 2>{ 64U, 48U },
+            std::array<uint, 2>{ 45U, 30U } })
+    {
+        const uint width = size[0];
+        const uint height = size[1];
+        const std::vector<float> src = generateRandomData(width * height);
+
+        Fft2dProto complex;
+        ASSERT_TRUE(complex.init(width, height));
+        ASSERT_TRUE(complex.calcForward(src.data()));
+        Fft2dRealProto ours;
+        ASSERT_TRUE(ours.init(width, height, FftAlgorithm::digitReversal, FftColumns::transposed));
+        ASSERT_TRUE(ours.calcForward(src.data()));
+        const uint spectrumWidth = ours.spectrumWidth();
+        for (uint y = 0; y < height; ++y)
+        {
+            for (uint i = 0; i < 2 * spectrumWidth; ++i)
+            {
+                ASSERT_LE(fabsf(ours.result()[2 * y * spectrumWidth + i] -
+                    complex.result()[2 * y * width + i]), 0.1f);
+            }
+        }
+
+        std::vector<float> spectrum(ours.result(), ours.result() + 2 * spectrumWidth * height);
+        ASSERT_TRUE(ours.calcInverse(spectrum.data()));
+        for (size_t i = 0; i < src.size(); ++i)
+        {
+            ASSERT_LE(fabsf(ours.result()[i] - src[i]), 1e-4f);
+        }
+    }
+}
+
+TEST(FftBenchmark, protoMixedRadix)
+{
+    for (const uint N : { 64U, 96U, 120U, 168U, 210U, 256U, 336U, 384U, 420U, 480U, 512U })
+    {
+        std::vector<float> src = generateRandomData(2 * N);
+        FftProto fft;
+        ASSERT_TRUE(fft.init(N));
+        const double us = measureMeanUs([&]() { fft.calc(src.data(), false); }, 2000);
+        std::cout << "N = " << N << ": " << us << "us\n";
+    }
+}
+
+TEST(FftBenchmark, protoRadix)
+{
+    // Single-radix sizes of a few thousand points, so each row times one codelet
+    for (const std::array<uint, 2> &radix : { std::array<uint, 2>{ 2U, 12U },
+            std::array<uint, 2>{ 3U, 7U }, std::array<uint, 2>{ 4U, 6U },
+            std::array<uint, 2>{ 5U, 5U }, std::array<uint, 2>{ 6U, 4U },
+            std::array<uint, 2>{ 7U, 4U }, std::array<uint, 2>{ 8U, 4U } })
+    {
+        const std::vector<uint> stages(radix[1], radix[0]);
+        const uint N = generateRandomData(stages).size();
+        const std::vector<float> src = generateRandomData(2 * N);
+        std::cout << "radix " << radix[0] << ", N = " << N << ":";
+        for (const FftAlgorithm algorithm : { FftAlgorithm::digitReversal, FftAlgorithm::stockham })
+        {
+            FftProto fft;
+            ASSERT_TRUE(fft.init(N, &stages, algorithm));
+            const double us = measureMeanUs([&]() { fft.calc(src.data(), false); }, 200);
+            std::cout << (algorithm == FftAlgorithm::stockham ? " Stockham " : " digit reversal ") <<
+                us << "us";
+        }
+        std::cout << "\n";
+    }
+}
+
+TEST(FftBenchmark, wisdom)
+{
+    FftWisdom wisdom;
+    for (const uint N : { 256U, 480U, 720U, 1280U, 4096U })
+    {
+        const FftWisdom::Plan *plan = wisdom.tune(N, 64);
+        ASSERT_NE(plan, nullptr);
+        std::cout << "N = " << N << ": default " << measureFftBatchCost(N,
+            FftAlgorithm::stockham, 2000) << "us, tuned";
+        for (const uint Ny : plan->stages_)
+        {
+            std::cout << " " << Ny;
+        }
+        std::cout << (plan->algorithm_ == FftAlgorithm::stockham ? " Stockham " : " digit reversal ")
+            << measureFftBatchCost(N, plan->algorithm_, 2000, plan->stagesOrNull()) << "us\n";
+    }
+}
+
+TEST(FftBenchmark, protoBluesteinAgainstPadding)
+{
+    for (const uint N : { 97U, 101U, 131U, 211U, 331U })
+    {
+        const uint padded = getNextRadixFftSize(N);
+        const uint cheapest = findCheapestFftSize(N, N + N / 3U,
+            [](uint n) { return measureFftCost(n, FftAlgorithm::stockham, 200); });
+        std::cout << "N = " << N << ": Bluestein " << measureFftCost(N, FftAlgorithm::stockham,
+            2000) << "us, padded to " << padded << " " << measureFftCost(padded,
+            FftAlgorithm::stockham, 2000) << "us, cheapest size " << cheapest << "\n";
+    }
+}
+
+TEST(FftBenchmark, correlationOverlapSave)
+{
+    // A grey 1280x720 frame against small templates: the whole frame as one circular
+    // correlation (template zero-padded to the frame) against overlap-save tiles
+    const uint width = 1280U;
+    const uint height = 720U;
+    const std::vector<float> frame = generateRandomData(width * height);
+    for (const uint templateSize : { 16U, 32U, 64U })
+    {
+        std::vector<float> templ(width * height, 0.0f);
+        std::copy(frame.begin(), frame.begin() + templateSize, templ.begin());
+        FftCorrelationProto whole;
+        ASSERT_TRUE(whole.init(width, height, 1U));
+        ASSERT_TRUE(whole.setTemplate(templ.data(), 1U));
+        FftCorrelationProto tiled;
+        ASSERT_TRUE(tiled.initOverlapSave(width, height, templateSize, templateSize, 1U));
+        ASSERT_TRUE(tiled.setTemplate(templ.data(), 1U));
+        const double wholeUs = measureMeanUs([&]() { whole.calc(frame.data(), 1U); }, 5);
+        const double tiledUs = measureMeanUs([&]() { tiled.calc(frame.data(), 1U); }, 5);
+        std::cout << "template " << templateSize << "x" << templateSize << ": whole frame " <<
+            wholeUs << "us, overlap-save " << tiled.tileWidth() << "x" << tiled.tileHeight() <<
+            " tiles " << tiledUs << "us\n";
+    }
+}
+
+TEST(FftBenchmark, proto2dRealAgainstComplex)
+{
+    const uint width = 64U;
+    const uint height = 48U;
+    const std::vector<float> src = generateRandomData(width * height);
+    Fft2dProto complex;
+    ASSERT_TRUE(complex.init(width, height));
+    Fft2dRealProto real;
+    ASSERT_TRUE(real.init(width, height));
+    const double complexUs = measureMeanUs([&]() { complex.calcForward(src.data()); }, 200);
+    const double realUs = measureMeanUs([&]() { real.calcForward(src.data()); }, 200);
+    std::cout << width << "x" << height << ": complex " << complexUs << "us, real " <<
+        realUs << "us\n";
+}
+
+TEST(FftBenchmark, protoStockhamAgainstDigitReversal)
+{
+    for (const uint N : { 64U, 512U, 4096U, 32768U, 40320U })
+    {
+        std::vector<float> src = generateRandomData(2 * N);
+        FftProto digitReversal;
+        ASSERT_TRUE(digitReversal.init(N, nullptr, FftAlgorithm::digitReversal));
+        FftProto stockham;
+        ASSERT_TRUE(stockham.init(N, nullptr, FftAlgorithm::stockham));
+        const int iterations = 200000 / N + 10;
+        const double digitReversalUs = measureMeanUs(
+            [&]() { digitReversal.calc(src.data(), false); }, iterations);
+        const double stockhamUs = measureMeanUs(
+            [&]() { stockham.calc(src.data(), false); }, iterations);
+        std::cout << "N = " << N << ": digit reversal " << digitReversalUs << "us, Stockham " <<
+            stockhamUs << "us\n";
+    }
+}
+
+TEST(FftBenchmark, protoBatchRows)
+{
+    // All the rows of 31 HOG channels of 64x48 cells
+    const uint N = 64U;
+    const uint lineCount = 31U * 48U;
+    std::vector<float> data = generateRandomData(2 * N * lineCount);
+    FftProto single;
+    ASSERT_TRUE(single.init(N, nullptr, FftAlgorithm::stockham));
+    const double singleUs = measureMeanUs([&]()
+    {
+        for (uint l = 0; l < lineCount; ++l)
+        {
+            single.calc(data.data() + 2 * l * N, false);
+            std::copy(single.result(), single.result() + 2 * N, data.data() + 2 * l * N);
+        }
+    }, 20);
+    std::cout << lineCount << " rows of " << N << ": one by one " << singleUs << "us";
+    for (const uint maxLaneCount : { 4U, 8U })
+    {
+        FftBatchProto batch;
+        ASSERT_TRUE(batch.init(N, FftAlgorithm::stockham, maxLaneCount));
+        const double batchUs = measureMeanUs(
+            [&]() { batch.calc(data.data(), lineCount, N, 1U, false); }, 20);
+        std::cout << ", " << batch.laneCount() << " lanes " << batchUs << "us";
+    }
+    std::cout << "\n";
+}
+
+TEST(FftBenchmark, proto2dColumns)
+{
+    for (const std::array<uint, 2> &size : { std::array<uint, 2>{ 96U, 160U },
+            std::array<uint, 2>{ 160U, 96U }, std::array<uint, 2>{ 210U, 126U } })
+    {
+        const std::vector<float> src = generateRandomData(2 * size[0] * size[1]);
+        std::cout << size[0] << "x" << size[1] << ":";
+        for (const FftColumns columns : { FftColumns::transposed, FftColumns::strided })
+        {
+            Fft2dProto fft;
+            ASSERT_TRUE(fft.init(size[0], size[1], FftAlgorithm::stockham, columns));
+            const double us = measureMeanUs([&]() { fft.calc(src.data(), false); }, 50);
+            std::cout << (columns == FftColumns::strided ? " strided " : " transposed ") << us <<
+                "us";
+        }
+        std::cout << "\n";
+    }
+}
+
+TEST(FftBenchmark, proto2dPruned)
+{
+    // A HOG map of a tracker window padded to a radix size, the response cropped back
+    const uint width = 128U;
+    const uint height = 96U;
+    const FftRect window{ 0U, 0U, 72U, 40U };
+    const std::vector<float> valid = generateRandomData(2 * window.width_ * window.height_);
+    std::vector<float> padded(2 * width * height, 0.0f);
+    for (uint y = 0; y < window.height_; ++y)
+    {
+        std::copy(valid.begin() + 2 * y * window.width_,
+            valid.begin() + 2 * (y + 1U) * window.width_, padded.begin() + 2 * y * width);
+    }
+    std::vector<float> dst(padded.size(), 0.0f);
+    Fft2dProto fft;
+    ASSERT_TRUE(fft.init(width, height, FftAlgorithm::stockham));
+    const double fullUs = measureMeanUs([&]() { fft.calc(padded.data(), false); }, 100);
+    const double prunedUs = measureMeanUs([&]()
+    {
+        fft.calcForwardPruned(valid.data(), window.width_, window, dst.data(), width);
+    }, 100);
+    const double fullInverseUs = measureMeanUs([&]() { fft.calc(dst.data(), true); }, 100);
+    const double prunedInverseUs = measureMeanUs([&]()
+    {
+        fft.calcInversePruned(dst.data(), width, window, padded.data(), window.width_);
+    }, 100);
+    std::cout << width << "x" << height << ", window " << window.width_ << "x" <<
+        window.height_ << ": forward full " << fullUs << "us pruned " << prunedUs <<
+        "us, inverse full " << fullInverseUs << "us pruned " << prunedInverseUs << "us\n";
+}
+
+TEST(FftBenchmark, proto2dThreads)
+{
+    const uint width = 256U;
+    const uint height = 240U;
+    const std::vector<float> src = generateRandomData(2 * width * height);
+    const int maxThreadCount = std::max(4, static_cast<int>(std::thread::hardware_concurrency()));
+    for (int threadCount = 1; threadCount <= maxThreadCount; threadCount *= 2)
+    {
+        ThreadPool threadPool;
+        ASSERT_TRUE(threadPool.init(threadCount));
+        Fft2dProto fft;
+        ASSERT_TRUE(fft.init(width, height, FftAlgorithm::stockham, FftColumns::strided,
+            &threadPool));
+        const double us = measureMeanUs([&]() { fft.calc(src.data(), false); }, 50);
+        std::cout << width << "x" << height << ", " << threadCount << " threads: " << us << "us\n";
+    }
+}
+
+TEST(FftBenchmark, proto2dChannels)
+{
+    // The HOG descriptor of a 96x160 window: 24x40 cells of 31 channels
+    const uint width = 24U;
+    const uint height = 40U;
+    const uint channelCount = 31U;
+    const std::vector<float> src = generateRandomData(width * height * channelCount);
+
+    Fft2dChannelsProto channels;
+    ASSERT_TRUE(channels.init(width, height, channelCount, FftAlgorithm::stockham));
+    const double channelsUs = measureMeanUs([&]()
+    {
+        channels.calcForward(src.data(), channelCount);
+    }, 50);
+
+    Fft2dProto plane;
+    ASSERT_TRUE(plane.init(width, height, FftAlgorithm::stockham));
+    std::vector<float> planeSrc(width * height, 0.0f);
+    std::vector<float> spectrum(2 * width * height * channelCount, 0.0f);
+    const double planesUs = measureMeanUs([&]()
+    {
+        for (uint c = 0; c < channelCount; ++c)
+        {
+            for (uint i = 0; i < width * height; ++i)
+            {
+                planeSrc[i] = src[i * channelCount + c];
+            }
+            plane.calcForward(planeSrc.data());
+            for (uint i = 0; i < width * height; ++i)
+            {
+                spectrum[2 * (i * channelCount + c)] = plane.result()[2 * i];
+                spectrum[2 * (i * channelCount + c) + 1] = plane.result()[2 * i + 1];
+            }
+        }
+    }, 50);
+    std::cout << width << "x" << height << "x" << channelCount << ": batched " << channelsUs <<
+        "us, plane by plane " << planesUs << "us\n";
+}
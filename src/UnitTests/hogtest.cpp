@@ -2,7 +2,9 @@
 #include <gtest/gtest.h>
 #include <fhog.hpp>
 #include <hog.h>
+#include <hogsimd.h>
 #include <oclprocessor.h>
+#include <threadpool.h>
 #include <testhelpers.h>
 
 class HogTestProcessor : public OclProcessor
@@ -18,14 +20,17 @@ public:
         release();
     }
 
-    bool setup(int width, int height)
+    bool setup(const HogSettings &settings)
     {
         release();
         if (OclProcessor::initialize() != CL_SUCCESS)
         {
             return false;
         }
-        if (!sett_.init(width, height))
+        sett_ = settings;
+        programCache_.initialize(oclContext_, getKernelSource(), oclProgram_);
+        cl_program program = NULL;
+        if (programCache_.program(sett_, program) != CL_SUCCESS)
         {
             return false;
         }
@@ -34,10 +39,11 @@ public:
         {
             return false;
         }
-        return hog_.initialize(sett_, oclContext_, oclProgram_, oclImGrayFloat_) == CL_SUCCESS;
+        return hog_.initialize(sett_, oclContext_, program, oclImGrayFloat_) == CL_SUCCESS;
     }
 
-    bool processFrame(const float *im, float *desc)
+    // With roi, only the descriptor of the roi, its cells in the first part of desc
+    bool processFrame(const float *im, float *desc, const cl_int4 *roi = nullptr)
     {
         cl_event imWriteEvent = NULL;
         cl_int status = clEnqueueWriteBuffer(oclQueue_, oclImGrayFloat_, CL_FALSE, 0,
@@ -45,17 +51,18 @@ public:
         cl_event hogEvent = NULL;
         if (status == CL_SUCCESS)
         {
-            status = hog_.calculate(oclQueue_, 1, &imWriteEvent, hogEvent);
+            status = roi ? hog_.calculate(oclQueue_, *roi, 1, &imWriteEvent, hogEvent) :
+                hog_.calculate(oclQueue_, 1, &imWriteEvent, hogEvent);
         }
         if (imWriteEvent)
         {
             clReleaseEvent(imWriteEvent);
             imWriteEvent = NULL;
         }
-        cl_float *mappedDesc = NULL;
+        void *mappedDesc = NULL;
         if (status == CL_SUCCESS)
         {
-            mappedDesc = (cl_float*)clEnqueueMapBuffer(oclQueue_, hog_.blockHog_.descriptor_,
+            mappedDesc = clEnqueueMapBuffer(oclQueue_, hog_.blockHog_.descriptor_,
                 CL_TRUE, CL_MAP_READ, 0, descSzInBytes(), 1, &hogEvent, NULL, &status);
         }
         if (hogEvent)
@@ -65,7 +72,7 @@ public:
         }
         if (mappedDesc)
         {
-            std::copy(mappedDesc, mappedDesc + sett_.descLen(), desc);
+            BlockHog::unpackDescriptor(sett_, mappedDesc, sett_.descLen(), desc);
         }
         cl_event unmapEvent = NULL;
         if (mappedDesc)
@@ -90,12 +97,13 @@ protected:
 
     int descSzInBytes() const
     {
-        return sett_.descLen() * sizeof(cl_float);
+        return sett_.descLen() * sett_.descriptorElementSize();
     }
 
     void release()
     {
         hog_.release();
+        programCache_.release();
         if (oclImGrayFloat_)
         {
             clReleaseMemObject(oclImGrayFloat_);
@@ -106,9 +114,101 @@ protected:
     HogSettings sett_;
     cl_mem oclImGrayFloat_ = nullptr;
     std::vector<float> desc;
+    HogProgramCache programCache_;
     Hog hog_;
 };
 
+class HogPyramidTestProcessor : public OclProcessor
+{
+public:
+    HogPyramidTestProcessor()
+    {
+        kernelPaths_ = { "hog.cl" };
+    }
+
+    ~HogPyramidTestProcessor()
+    {
+        release();
+    }
+
+    bool setup(const HogSettings &settings, const std::vector<float> &scales)
+    {
+        release();
+        if (OclProcessor::initialize() != CL_SUCCESS)
+        {
+            return false;
+        }
+        sett_ = settings;
+        oclImGrayFloat_ = clCreateBuffer(oclContext_, CL_MEM_READ_ONLY,
+            sett_.imWidth() * sett_.imHeight() * sizeof(cl_float), NULL, NULL);
+        if (!oclImGrayFloat_)
+        {
+            return false;
+        }
+        return pyramid_.initialize(sett_, scales, oclContext_, oclProgram_, oclImGrayFloat_) ==
+            CL_SUCCESS;
+    }
+
+    // Every scale, packed like the buffers of HogPyramid
+    bool processFrame(const float *im, std::vector<float> &scaledImages, std::vector<float> &desc)
+    {
+        const HogSettings &last = pyramid_.scaleSettings_.back();
+        scaledImages.resize(pyramid_.imageOffsets_.back() + last.imWidth() * last.imHeight());
+        desc.resize((pyramid_.cellOffsets_.back() + last.cellCount_[0] * last.cellCount_[1]) *
+            last.channelsPerBlock());
+        cl_event imWriteEvent = NULL;
+        cl_int status = clEnqueueWriteBuffer(oclQueue_, oclImGrayFloat_, CL_FALSE, 0,
+            sett_.imWidth() * sett_.imHeight() * sizeof(cl_float), im, 0, NULL, &imWriteEvent);
+        cl_event hogEvent = NULL;
+        if (status == CL_SUCCESS)
+        {
+            status = pyramid_.calculate(oclQueue_, 1, &imWriteEvent, hogEvent);
+        }
+        if (imWriteEvent)
+        {
+            clReleaseEvent(imWriteEvent);
+            imWriteEvent = NULL;
+        }
+        if (status == CL_SUCCESS)
+        {
+            status = clEnqueueReadBuffer(oclQueue_, pyramid_.scaledImages_, CL_TRUE, 0,
+                scaledImages.size() * sizeof(cl_float), scaledImages.data(), 1, &hogEvent, NULL);
+        }
+        std::vector<unsigned char> packedDesc(desc.size() * sett_.descriptorElementSize());
+        if (status == CL_SUCCESS)
+        {
+            status = clEnqueueReadBuffer(oclQueue_, pyramid_.descriptor_, CL_TRUE, 0,
+                packedDesc.size(), packedDesc.data(), 0, NULL, NULL);
+        }
+        if (status == CL_SUCCESS)
+        {
+            BlockHog::unpackDescriptor(sett_, packedDesc.data(), desc.size(), desc.data());
+        }
+        if (hogEvent)
+        {
+            clReleaseEvent(hogEvent);
+            hogEvent = NULL;
+        }
+        return status == CL_SUCCESS;
+    }
+
+    HogPyramid pyramid_;
+
+protected:
+    void release()
+    {
+        pyramid_.release();
+        if (oclImGrayFloat_)
+        {
+            clReleaseMemObject(oclImGrayFloat_);
+            oclImGrayFloat_ = NULL;
+        }
+    }
+
+    HogSettings sett_;
+    cl_mem oclImGrayFloat_ = nullptr;
+};
+
 class HogTest : public ::testing::Test
 {
 public:
@@ -170,15 +270,328 @@ TEST_F(HogTest, protoAgainstPiotr)
     compareDescriptors(proto.blockDescriptor_, piotr.data());
 }
 
+TEST_F(HogTest, protoParallelAgainstSerial)
+{
+    HogProto serial;
+    serial.initialize(sett_);
+    serial.calculate((float*)ocvImGrayFloat_.data);
+    // Including more threads than some bands have cell rows
+    for (int threadCount : { 2, 3, 8 })
+    {
+        ThreadPool pool;
+        ASSERT_TRUE(pool.init(threadCount));
+        HogProto parallel;
+        parallel.initialize(sett_, &pool);
+        parallel.calculate((float*)ocvImGrayFloat_.data);
+        for (int i = 0; i < sett_.descLen(); ++i)
+        {
+            ASSERT_EQ(serial.blockDescriptor_[i], parallel.blockDescriptor_[i]);
+        }
+    }
+}
+
+TEST_F(HogTest, protoIncrementalAgainstFull)
+{
+    const float *frame = (float*)ocvImGrayFloat_.data;
+    HogSettings settings = sett_;
+    ASSERT_TRUE(settings.init(160, 96));
+    // Shifts in every direction, no shift, a new frame and a window without overlap
+    const int windowCells[][2] = {
+        { 2, 3 }, { 4, 4 }, { 1, 6 }, { 1, 6 }, { 0, 5 }, { 30, 20 }, { 31, 20 }, { 29, 19 } };
+    const bool frameUnchanged[] = { true, true, true, true, false, true, true, true };
+    HogProto incremental;
+    incremental.initialize(settings);
+    for (size_t w = 0; w < sizeof(frameUnchanged) / sizeof(frameUnchanged[0]); ++w)
+    {
+        const int *windowCell = windowCells[w];
+        ASSERT_LE(windowCell[0] + settings.cellCount_[0], sett_.cellCount_[0]);
+        ASSERT_LE(windowCell[1] + settings.cellCount_[1], sett_.cellCount_[1]);
+        incremental.calculate(frame, sett_.imWidth(), windowCell, frameUnchanged[w]);
+
+        std::vector<float> window(settings.imWidth() * settings.imHeight());
+        for (int y = 0; y < settings.imHeight(); ++y)
+        {
+            const float *row = frame + (windowCell[1] * settings.cellSize_ + y) * sett_.imWidth() +
+                windowCell[0] * settings.cellSize_;
+            std::copy(row, row + settings.imWidth(), window.data() + y * settings.imWidth());
+        }
+        HogProto full;
+        full.initialize(settings);
+        full.calculate(window.data());
+        for (int i = 0; i < settings.descLen(); ++i)
+        {
+            ASSERT_EQ(incremental.blockDescriptor_[i], full.blockDescriptor_[i]);
+        }
+    }
+}
+
 TEST_F(HogTest, oclAgainstProto)
 {
     HogProto proto;
     proto.initialize(sett_);
     proto.calculate((float*)ocvImGrayFloat_.data);
     HogTestProcessor ocl;
-    ASSERT_TRUE(ocl.setup(sett_.imWidth(), sett_.imHeight()));
+    ASSERT_TRUE(ocl.setup(sett_));
     std::vector<float> oclDesc(sett_.descLen(), 0.0f);
     ASSERT_TRUE(ocl.processFrame((float*)ocvImGrayFloat_.data, oclDesc.data()));
     compareDescriptors(oclDesc.data(), proto.blockDescriptor_);
 }
 
+TEST_F(HogTest, protoFastBinningAgainstExact)
+{
+    HogProto exact;
+    exact.initialize(sett_);
+    exact.calculate((float*)ocvImGrayFloat_.data);
+    HogSettings settings = sett_;
+    settings.fastBinning_ = true;
+    HogProto fast;
+    fast.initialize(settings);
+    fast.calculate((float*)ocvImGrayFloat_.data);
+    compareDescriptors(fast.blockDescriptor_, exact.blockDescriptor_);
+    // The interpolated table is off by about 2e-4 bins
+    for (int i = 0; i < sett_.descLen(); ++i)
+    {
+        ASSERT_LE(fabsf(fast.blockDescriptor_[i] - exact.blockDescriptor_[i]), 1e-3f);
+    }
+}
+
+TEST_F(HogTest, oclFastBinningAgainstExact)
+{
+    std::vector<float> exactDesc(sett_.descLen(), 0.0f);
+    std::vector<float> fastDesc(sett_.descLen(), 0.0f);
+    for (bool fastBinning : { false, true })
+    {
+        HogSettings settings = sett_;
+        settings.fastBinning_ = fastBinning;
+        HogTestProcessor ocl;
+        ASSERT_TRUE(ocl.setup(settings));
+        ASSERT_TRUE(ocl.processFrame((float*)ocvImGrayFloat_.data,
+            fastBinning ? fastDesc.data() : exactDesc.data()));
+    }
+    compareDescriptors(fastDesc.data(), exactDesc.data());
+    for (int i = 0; i < sett_.descLen(); ++i)
+    {
+        ASSERT_LE(fabsf(fastDesc[i] - exactDesc[i]), 1e-3f);
+    }
+}
+
+TEST_F(HogTest, oclFusedAgainstSeparate)
+{
+    std::vector<float> separateDesc(sett_.descLen(), 0.0f);
+    std::vector<float> fusedDesc(sett_.descLen(), 0.0f);
+    for (bool fusedKernels : { false, true })
+    {
+        HogSettings settings = sett_;
+        settings.fusedKernels_ = fusedKernels;
+        HogTestProcessor ocl;
+        ASSERT_TRUE(ocl.setup(settings));
+        ASSERT_TRUE(ocl.processFrame((float*)ocvImGrayFloat_.data,
+            fusedKernels ? fusedDesc.data() : separateDesc.data()));
+    }
+    // The same sums from the same cell histograms
+    for (int i = 0; i < sett_.descLen(); ++i)
+    {
+        ASSERT_NEAR(fusedDesc[i], separateDesc[i], 1e-6f);
+    }
+}
+
+TEST_F(HogTest, oclRoiAgainstCroppedImage)
+{
+    const float *image = (float*)ocvImGrayFloat_.data;
+    // The second size follows the first, so the cell norms padding is cleared in between
+    const cl_int4 rois[] = {
+        { { 64, 48, 320, 160 } }, { { 100, 200, 256, 96 } }, { { 100, 200, 256, 96 } } };
+    for (bool fusedKernels : { false, true })
+    {
+        HogSettings settings = sett_;
+        settings.fusedKernels_ = fusedKernels;
+        HogTestProcessor ocl;
+        ASSERT_TRUE(ocl.setup(settings));
+        std::vector<float> desc(sett_.descLen(), 0.0f);
+        ASSERT_TRUE(ocl.processFrame(image, desc.data()));
+        const cl_int4 misaligned = { { 2, 0, 64, 64 } };
+        ASSERT_FALSE(ocl.processFrame(image, desc.data(), &misaligned));
+        for (const cl_int4 &roi : rois)
+        {
+            ASSERT_TRUE(ocl.processFrame(image, desc.data(), &roi));
+
+            std::vector<float> crop(roi.s[2] * roi.s[3]);
+            for (int y = 0; y < roi.s[3]; ++y)
+            {
+                const float *row = image + (roi.s[1] + y) * sett_.imWidth() + roi.s[0];
+                std::copy(row, row + roi.s[2], crop.data() + y * roi.s[2]);
+            }
+            HogSettings cropSettings = settings;
+            ASSERT_TRUE(cropSettings.init(roi.s[2], roi.s[3]));
+            HogTestProcessor cropOcl;
+            ASSERT_TRUE(cropOcl.setup(cropSettings));
+            std::vector<float> cropDesc(cropSettings.descLen(), 0.0f);
+            ASSERT_TRUE(cropOcl.processFrame(crop.data(), cropDesc.data()));
+            for (int i = 0; i < cropSettings.descLen(); ++i)
+            {
+                ASSERT_EQ(desc[i], cropDesc[i]);
+            }
+        }
+    }
+}
+
+TEST_F(HogTest, oclSettingsAgainstProto)
+{
+    // Larger cells with their work-groups, then fewer bins with another truncation
+    HogSettings configs[3] = { sett_, sett_, sett_ };
+    configs[0].cellSize_ = 8;
+    configs[1].cellSize_ = 6;
+    configs[1].wgSize_[0] = configs[1].wgSize_[1] = 12;
+    configs[2].insensitiveBinCount_ = 6;
+    configs[2].truncation_ = 0.25f;
+    for (HogSettings &settings : configs)
+    {
+        // The largest multiple of the work-group size in the test image
+        const int width = sett_.imWidth() / settings.wgSize_[0] * settings.wgSize_[0];
+        const int height = sett_.imHeight() / settings.wgSize_[1] * settings.wgSize_[1];
+        ASSERT_TRUE(settings.init(width, height));
+        std::vector<float> image(width * height);
+        for (int y = 0; y < height; ++y)
+        {
+            const float *row = (float*)ocvImGrayFloat_.data + y * sett_.imWidth();
+            std::copy(row, row + width, image.data() + y * width);
+        }
+        HogProto proto;
+        proto.initialize(settings);
+        proto.calculate(image.data());
+        for (bool fusedKernels : { false, true })
+        {
+            settings.fusedKernels_ = fusedKernels;
+            HogTestProcessor ocl;
+            ASSERT_TRUE(ocl.setup(settings));
+            std::vector<float> oclDesc(settings.descLen(), 0.0f);
+            ASSERT_TRUE(ocl.processFrame(image.data(), oclDesc.data()));
+            for (int i = 0; i < settings.descLen(); ++i)
+            {
+                ASSERT_NEAR(oclDesc[i], proto.blockDescriptor_[i], 1e-3f);
+            }
+        }
+    }
+}
+
+TEST_F(HogTest, oclDescriptorFormatsAgainstProto)
+{
+    HogProto proto;
+    proto.initialize(sett_);
+    proto.calculate((float*)ocvImGrayFloat_.data);
+    HogSettings settings = sett_;
+    for (HogDescriptorFormat format : { HogDescriptorFormat::float16, HogDescriptorFormat::uint8 })
+    {
+        settings.descriptorFormat_ = format;
+        // Half floats keep 11 bits of the at most 0.2 values, bytes are rounded to 1/255 of
+        // maxDescriptorValue()
+        const float tolerance = format == HogDescriptorFormat::uint8 ?
+            1e-3f + 0.5f * settings.maxDescriptorValue() / 255.0f : 1e-3f;
+        for (bool fusedKernels : { false, true })
+        {
+            settings.fusedKernels_ = fusedKernels;
+            HogTestProcessor ocl;
+            ASSERT_TRUE(ocl.setup(settings));
+            std::vector<float> oclDesc(settings.descLen(), 0.0f);
+            ASSERT_TRUE(ocl.processFrame((float*)ocvImGrayFloat_.data, oclDesc.data()));
+            for (int i = 0; i < settings.descLen(); ++i)
+            {
+                ASSERT_NEAR(oclDesc[i], proto.blockDescriptor_[i], tolerance);
+            }
+        }
+    }
+}
+
+TEST_F(HogTest, oclPyramidAgainstSingleScale)
+{
+    const float *image = (float*)ocvImGrayFloat_.data;
+    const std::vector<float> scales = { 0.5f, 0.42f, 0.35f };
+    HogPyramidTestProcessor pyramid;
+    ASSERT_TRUE(pyramid.setup(sett_, scales));
+    std::vector<float> scaledImages;
+    std::vector<float> desc;
+    ASSERT_TRUE(pyramid.processFrame(image, scaledImages, desc));
+    for (size_t s = 0; s < scales.size(); ++s)
+    {
+        HogSettings scaleSettings = pyramid.pyramid_.scaleSettings_[s];
+        const int width = scaleSettings.imWidth();
+        const int height = scaleSettings.imHeight();
+        const float *scaled = scaledImages.data() + pyramid.pyramid_.imageOffsets_[s];
+        // Bilinear with the pixel centres aligned as in resampleScales
+        for (int y = 0; y < height; ++y)
+        {
+            float srcY = fminf(fmaxf((y + 0.5f) * sett_.imHeight() / height - 0.5f, 0.0f),
+                sett_.imHeight() - 1);
+            int y0 = (int)srcY;
+            int y1 = std::min(y0 + 1, sett_.imHeight() - 1);
+            for (int x = 0; x < width; ++x)
+            {
+                float srcX = fminf(fmaxf((x + 0.5f) * sett_.imWidth() / width - 0.5f, 0.0f),
+                    sett_.imWidth() - 1);
+                int x0 = (int)srcX;
+                int x1 = std::min(x0 + 1, sett_.imWidth() - 1);
+                const float *row0 = image + y0 * sett_.imWidth();
+                const float *row1 = image + y1 * sett_.imWidth();
+                float top = row0[x0] + (row0[x1] - row0[x0]) * (srcX - x0);
+                float bottom = row1[x0] + (row1[x1] - row1[x0]) * (srcX - x0);
+                ASSERT_NEAR(scaled[y * width + x], top + (bottom - top) * (srcY - y0), 1e-2f);
+            }
+        }
+
+        // The pyramid runs the fused kernels
+        scaleSettings.fusedKernels_ = true;
+        HogTestProcessor single;
+        ASSERT_TRUE(single.setup(scaleSettings));
+        std::vector<float> singleDesc(scaleSettings.descLen(), 0.0f);
+        ASSERT_TRUE(single.processFrame(scaled, singleDesc.data()));
+        const float *scaleDesc = desc.data() +
+            pyramid.pyramid_.cellOffsets_[s] * scaleSettings.channelsPerBlock();
+        for (int i = 0; i < scaleSettings.descLen(); ++i)
+        {
+            ASSERT_EQ(scaleDesc[i], singleDesc[i]);
+        }
+    }
+}
+
+TEST_F(HogTest, simdAgainstProto)
+{
+    HogProto proto;
+    proto.initialize(sett_);
+    proto.calculate((float*)ocvImGrayFloat_.data);
+    ThreadPool pool;
+    ASSERT_TRUE(pool.init(3));
+    for (int maxLaneCount : { 4, 8 })
+    {
+        for (ThreadPool *threadPool : { (ThreadPool*)nullptr, &pool })
+        {
+            HogSimd simd;
+            simd.initialize(sett_, threadPool, maxLaneCount);
+            ASSERT_LE(simd.laneCount(), maxLaneCount);
+            simd.calculate((float*)ocvImGrayFloat_.data);
+            compareDescriptors(simd.blockDescriptor_, proto.blockDescriptor_);
+            // Only the atan2 approximation differs
+            for (int i = 0; i < sett_.descLen(); ++i)
+            {
+                ASSERT_LE(fabsf(simd.blockDescriptor_[i] - proto.blockDescriptor_[i]), 1e-5f);
+            }
+        }
+    }
+}
+
+TEST_F(HogTest, benchmarkSimdAgainstProto)
+{
+    HogProto proto;
+    proto.initialize(sett_);
+    const double protoUs = measureMeanUs(
+        [&]() { proto.calculate((float*)ocvImGrayFloat_.data); }, 10);
+    std::cout << sett_.imWidth() << "x" << sett_.imHeight() << " proto: " << protoUs << "us";
+    for (int maxLaneCount : { 4, 8 })
+    {
+        HogSimd simd;
+        simd.initialize(sett_, nullptr, maxLaneCount);
+        const double simdUs = measureMeanUs(
+            [&]() { simd.calculate((float*)ocvImGrayFloat_.data); }, 10);
+        std::cout << ", " << simd.laneCount() << " lanes: " << simdUs << "us";
+    }
+    std::cout << "\n";
+}
@@ -1,6 +1,7 @@
 #ifndef TESTHELPERS_H
 #define TESTHELPERS_H
 
+#include <chrono>
 #include <QImage>
 
 struct TestImageSettings
@@ -16,4 +17,18 @@ inline QImage loadTestImage()
     return QImage(s.path_).convertToFormat(QImage::Format_RGB888);
 }
 
+// Mean wall-clock time of a single call in microseconds (the first call is a warm-up)
+template <typename Func>
+inline double measureMeanUs(Func &&func, const int iterations)
+{
+    func();
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        func();
+    }
+    const auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(finish - start).count() / iterations;
+}
+
 #endif // TESTHELPERS_H